@@ -0,0 +1,7 @@
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    tests/categorizer \
+    tests/sqlcategorizer \
+    tracereplay \
+    hotpathbench
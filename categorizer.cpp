@@ -1,6 +1,13 @@
 #include "categorizer.h"
 #include <QList>
 #include <QPersistentModelIndex>
+#include <QMimeData>
+#include <QDataStream>
+#include <QIODevice>
+#include <QSet>
+#include <QCollator>
+#include <algorithm>
+#include <set>
 class TreeRow;
 class TreeRowData{
     Q_DISABLE_COPY(TreeRowData)
@@ -10,7 +17,10 @@ class TreeRowData{
     int parentCol;
     QList<TreeRow*> children;
     QList<QPersistentModelIndex> columns;
-    QVariant category;
+    int keyId;
+    QCollatorSortKey* sortKey;
+    QVector<int> pendingRows;
+    mutable int rowHint;
     ~TreeRowData();
     friend TreeRow;
 };
@@ -26,8 +36,14 @@ public:
     void setParent(TreeRow* par);
     int parentColumn() const;
     void setParentColumn(int parCol);
-    const QVariant& category() const;
-    void setCategory(const QVariant& cat);
+    int keyId() const;
+    void setKeyId(int id);
+    const QCollatorSortKey* sortKey() const;
+    void setSortKey(const QCollatorSortKey& key);
+    const QVector<int>& pendingRows() const;
+    QVector<int>& pendingRows();
+    int rowHint() const;
+    void setRowHint(int row) const;
     const QList<TreeRow*>& children() const;
     QList<TreeRow*>& children();
     const QList<QPersistentModelIndex>& columns() const;
@@ -71,14 +87,45 @@ void TreeRow::setParentColumn(int parCol)
     m_data->parentCol = parCol;
 }
 
-const QVariant& TreeRow::category() const
+int TreeRow::keyId() const
 {
-    return m_data->category;
+    return m_data->keyId;
 }
 
-void TreeRow::setCategory(const QVariant& cat)
+void TreeRow::setKeyId(int id)
 {
-    m_data->category = cat;
+    m_data->keyId = id;
+}
+
+const QCollatorSortKey* TreeRow::sortKey() const
+{
+    return m_data->sortKey;
+}
+
+void TreeRow::setSortKey(const QCollatorSortKey& key)
+{
+    delete m_data->sortKey;
+    m_data->sortKey = new QCollatorSortKey(key);
+}
+
+const QVector<int>& TreeRow::pendingRows() const
+{
+    return m_data->pendingRows;
+}
+
+QVector<int>& TreeRow::pendingRows()
+{
+    return m_data->pendingRows;
+}
+
+int TreeRow::rowHint() const
+{
+    return m_data->rowHint;
+}
+
+void TreeRow::setRowHint(int row) const
+{
+    m_data->rowHint = row;
 }
 
 const QList<TreeRow*>& TreeRow::children() const
@@ -105,19 +152,47 @@ TreeRowData::TreeRowData(TreeRow* par, int parCol, const QList<QPersistentModelI
     : parent(par)
     , columns(cols)
     , parentCol(parCol)
+    , keyId(-1)
+    , sortKey(Q_NULLPTR)
+    , rowHint(-1)
 {}
 
 TreeRowData::TreeRowData(TreeRow* par, int parCol) 
     :parent(par)
     , parentCol(parCol)
+    , keyId(-1)
+    , sortKey(Q_NULLPTR)
+    , rowHint(-1)
 {}
 
 TreeRowData::~TreeRowData()
 {
+    delete sortKey;
     for (auto i = children.begin(); i != children.end(); ++i)
         delete (*i);
 }
 
+struct InternedKey{
+    QVariant key;
+    QString normalized;
+    uint hash;
+    TreeRow* category;
+};
+
+struct StoredStructure{
+    int keyColumn;
+    int keyRole;
+    int normalization;
+    QString collationLocale;
+    bool multiValuedKeys;
+    QVector<qint32> rootPath;
+    int sourceDepth;
+    int rowCount;
+    QVariantList keys;
+    QVector<qint32> rowCategories;
+    QVector<qint32> rowOffsets;
+};
+
 class CategorizerPrivate{
     Q_DISABLE_COPY(CategorizerPrivate)
     Q_DECLARE_PUBLIC(Categorizer);
@@ -126,15 +201,148 @@ class CategorizerPrivate{
     QList<QMetaObject::Connection> m_sourceConnections;
     int m_keyColumn;
     int m_keyRole;
+    bool m_bulkRekey;
+    QList<QPersistentModelIndex> m_bulkChangedKeys;
+    Categorizer::KeyNormalization m_normalization;
+    QCollator m_collator;
     Categorizer* q_ptr;
     QHash<QPersistentModelIndex, TreeRow*> m_mapping;
     QList<TreeRow*> m_treeStructure;
+    QVector<InternedKey> m_internedKeys;
+    QVector<int> m_freeKeyIds;
+    QMultiHash<uint, int> m_keyIds;
+    int m_topCategories;
+    int m_categoryThreshold;
+    QString m_otherLabel;
+    TreeRow* m_otherCategory;
+    QHash<TreeRow*, int> m_rankedCounts;
+    std::set<std::pair<int, TreeRow*> > m_visibleRanks;
+    std::set<std::pair<int, TreeRow*> > m_foldedRanks;
+    bool m_lazyPopulation;
+    int m_fetchBatchSize;
+    QList<TreeRow*> m_pendingCategories;
+    QSet<TreeRow*> m_pendingCategorySet;
+    QVector<TreeRow*> m_rowCategory;
+    bool m_multiValuedKeys;
+    QHash<TreeRow*, TreeRow*> m_primaryLeaf;
+    QHash<TreeRow*, QList<TreeRow*> > m_extraLeaves;
+    StoredStructure* m_storedStructure;
+    QVector<int> m_groupOffsets;
+    QList<TreeRow*> m_groupCategories;
+    QHash<const TreeRow*, int> m_expectedSizes;
+    bool m_pushdownRejected;
+    mutable CategorizerSnapshot m_snapshot;
+    mutable bool m_snapshotValid;
+    mutable QHash<const TreeRow*, QVector<int> > m_snapshotRows;
+    QPersistentModelIndex m_sourceRoot;
+    int m_sourceDepth;
+    QVector<QPersistentModelIndex> m_rowParents;
+    QHash<QPersistentModelIndex, int> m_parentOrdinals;
+    QVector<int> m_parentOffsets;
+    bool m_sourceResetPending;
+    bool m_clearRootOnReset;
+    enum KeyHashing : quint8 { UnknownHashing, TrustedHashing, ScanHashing };
+    mutable KeyHashing m_keyHashing;
+    mutable bool m_probingKeyFunctions;
+    mutable int m_defaultSameKeyReached;
+    mutable int m_defaultKeyHashReached;
     TreeRow* itemForIndex(const QModelIndex& idx) const;
     QModelIndex indexForItem(TreeRow* const item, int col) const;
+    int rowForItem(const TreeRow* item) const;
+    bool isCategory(const TreeRow* item) const;
+    bool isCategoryLeaf(const TreeRow* item) const;
+    QList<TreeRow*> categories() const;
+    bool overflowEnabled() const;
+    bool otherShown() const;
+    void showOther();
+    void hideOtherIfEmpty();
+    bool shouldShowNewCategory() const;
+    void updateCategoryRank(TreeRow* category);
+    void foldCategory(TreeRow* category);
+    void promoteCategory(TreeRow* category);
+    void rebalanceCategories();
+    void partitionCategories();
+    int categorySize(const TreeRow* category) const;
+    TreeRow* createLeaf(TreeRow* category, int sourceRow, int position);
+    void materializeRows(TreeRow* category, const QVector<int>& sourceRows);
+    void addPendingRows(TreeRow* category, const QVector<int>& sourceRows);
+    void removePendingRow(TreeRow* category, int sourceRow);
+    void shiftPendingRows(int first, int count);
+    void demoteToPending(TreeRow* sourceCategory, const QList<TreeRow*>& items, TreeRow* destinationCategory);
+    void fetchCategories(int count);
+    void fetchLeaves(TreeRow* category, int count);
+    bool lazyEnabled() const;
+    bool isMultiValue(const QVariant& key) const;
+    QVariantList splitKey(const QVariant& key) const;
+    bool sameCategoryKey(const QVariant& left, const QVariant& right) const;
+    QVariant replaceKey(const QVariant& currentKey, const QVariant& fromKey, const QVariant& toKey) const;
+    TreeRow* createExtraLeaf(TreeRow* category, TreeRow* primary, int position);
+    void removeExtraLeaf(TreeRow* leaf);
+    void insertRowLeaves(int sourceRow, const QVariantList& keys);
+    void applyMultiKeyChange(TreeRow* primary, const QVariantList& keys);
+    void forwardDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles);
     void clearTreeStructure();
     void rebuildMapping();
+    void fillMapping();
+    void beginSourceReset(bool clearRoot);
+    void endSourceReset();
+    void onSourceModelAboutToBeReset();
+    void collectRowParents();
+    bool isCategorizedParent(const QModelIndex& parent) const;
+    bool isAboveRowParents(const QModelIndex& parent) const;
+    int rowOffset(const QModelIndex& parent) const;
+    int flatRow(const QModelIndex& idx) const;
+    void shiftRowOffsets(const QModelIndex& parent, int count);
+    QModelIndex fetchableParent() const;
+    bool removesSourceRoot(const QModelIndex& parent, int first, int last) const;
+    QVector<qint32> sourceRootPath() const;
+    int sourceRowCount() const;
+    int sourceColumnCount() const;
+    QModelIndex sourceIndex(int row, int column) const;
+    TreeRow* rootCategoryForKey(const QVariant& key);
+    bool pushdownEnabled() const;
+    bool loadGroups();
+    TreeRow* groupCategory(int sourceRow) const;
+    bool groupsMatch(int first, int last) const;
+    void insertGroupRows(int first, int count);
+    void removeGroupRows(int first, int last);
+    void adjustExpectedSize(const TreeRow* category, int delta);
+    void rejectGroups();
+    void fetchSourceRows(TreeRow* category);
+    void invalidateSnapshot();
+    void invalidateSnapshotOrder();
+    void invalidateSnapshotRows(const TreeRow* category);
+    void invalidateSnapshotRowsFrom(int sourceRow);
+    void onProxyRowsChanged(const QModelIndex& parent);
+    QVector<int> snapshotRows(const TreeRow* category) const;
+    void buildSnapshot() const;
+    void restoreCategories(const StoredStructure& stored);
+    bool canRestore(const StoredStructure& stored) const;
+    bool writeStructure(QIODevice* device, quint64 sourceVersion) const;
+    static bool canSaveKey(const QVariant& key);
+    bool readStructure(QIODevice* device, quint64 sourceVersion, StoredStructure& stored) const;
     void rebuildTreeStructure(const QModelIndex &sourceParent, TreeRow* currParent, int parentCol);
-    int indexForKey(const QVariant& key) const;
+    QString normalizedKey(const QVariant& key) const;
+    uint internedHash(const QVariant& key, const QString& normalized) const;
+    bool keyHashTrusted() const;
+    int keyId(const QVariant& key, const QString& normalized) const;
+    int internKey(const QVariant& key, const QString& normalized, TreeRow* category);
+    void releaseKey(int id);
+    QVariant categoryKey(const TreeRow* category) const;
+    bool keyMatches(const TreeRow* category, const QVariant& key, const QString& normalized) const;
+    TreeRow* findCategory(const QVariant& key, const QString& normalized) const;
+    TreeRow* createCategory(const QVariant& key, const QString& normalized);
+    int categoryInsertIndex(const QList<TreeRow*>& siblings, const TreeRow* category) const;
+    TreeRow* categoryForKey(const QVariant& key, const QString& normalized);
+    void destroyCategory(QList<TreeRow*>& siblings, int catRow);
+    int childInsertIndex(const TreeRow* category, int sourceRow) const;
+    void moveToCategory(TreeRow* sourceCategory, const QList<TreeRow*>& items, TreeRow* destinationCategory);
+    void removeCategories(const QSet<TreeRow*>& categoriesToRemove);
+    void removeEmptyCategories();
+    void applyKeyChanges(const QList<QPersistentModelIndex>& keyIndexes);
+    bool rekeyRows(const QList<QPersistentModelIndex>& keyIndexes, const QVariantList& fromKeys, const QVariant& key);
+    TreeRow* dropCategory(const QModelIndex& parent) const;
+    QList<QPersistentModelIndex> decodeRows(const QMimeData* data, QVariantList* fromKeys) const;
     void removeFromMapping(TreeRow* item);
     void onSourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles);
     void onSourceRowsInserted(const QModelIndex &parent, int first, int last);
@@ -143,21 +351,26 @@ class CategorizerPrivate{
     void onSourceRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last);
     void onSourceRowsRemoved(const QModelIndex &parent, int first, int last);
     enum {RootDataRole = Qt::UserRole};
+    static QString rowsMimeType() { return QStringLiteral("application/x-categorizer-rows"); }
+    enum : quint32 { StructureMagic = 0x43545253 };
+    enum : quint16 { StructureVersion = 3 };
 };
 
 QModelIndex Categorizer::index(int row, int column, const QModelIndex &parent) const
 {
-    if (!hasChildren(parent))
+    if (!sourceModel() || row < 0 || column < 0)
         return QModelIndex();
-    if (row<0 || row>=rowCount(parent))
+    Q_D(const Categorizer);
+    const QList<TreeRow*>& siblings = parent.isValid() ? d->itemForIndex(parent)->children() : d->m_treeStructure;
+    if (row >= siblings.size())
         return QModelIndex();
-    if (column<0 || column>=columnCount(parent))
+    TreeRow* const item = siblings.at(row);
+    // rows of the source hang from the column they belong to, categories only from the first one
+    if (parent.isValid() && parent.column() != item->parentColumn())
         return QModelIndex();
-    if (!parent.isValid())
-        return createIndex(row, column, Q_NULLPTR);
-    Q_ASSERT(parent.model() == this);
-    Q_D(const Categorizer);
-    return createIndex(row, column, d->itemForIndex(parent));
+    if (column >= (item->columns().isEmpty() ? d->sourceColumnCount() : item->columns().size()))
+        return QModelIndex();
+    return createIndex(row, column, item);
 }
 
 bool Categorizer::insertRows(int row, int count, const QModelIndex &parent) 
@@ -173,15 +386,18 @@ bool Categorizer::removeRows(int row, int count, const QModelIndex &parent)
     if (!parent.isValid() || !sourceModel() || row<0 || count <= 0)
         return false;
     Q_ASSERT(parent.model() == this);
-    if (parent.parent().isValid())
-        return sourceModel()->removeRows(row, count, mapToSource(parent));
     Q_D(Categorizer);
     const TreeRow* const parentItem = d->itemForIndex(parent);
+    if (!parentItem || parentItem == d->m_otherCategory)
+        return false;
+    if (!d->isCategory(parentItem))
+        return sourceModel()->removeRows(row, count, mapToSource(parent));
     if (row >= parentItem->children().size())
         return false;
     const QList<QPersistentModelIndex>& childCols = parentItem->children().at(row)->columns();
     Q_ASSERT(!childCols.isEmpty());
-    return sourceModel()->removeRows(childCols.first().row(), count, QModelIndex());
+    const QModelIndex firstRow = childCols.first();
+    return sourceModel()->removeRows(firstRow.row(), count, firstRow.parent());
 /*
 
 
@@ -224,12 +440,28 @@ bool Categorizer::removeRows(int row, int count, const QModelIndex &parent)
 
 bool Categorizer::moveRows(const QModelIndex &sourceParent, int sourceRow, int count, const QModelIndex &destinationParent, int destinationChild) 
 {
-    Q_UNUSED(sourceParent)
-    Q_UNUSED(count)
-    Q_UNUSED(sourceRow)
-    Q_UNUSED(destinationParent)
+    // the position inside a category is dictated by the order in the source
     Q_UNUSED(destinationChild)
-    return false;
+    if (!sourceModel() || sourceRow < 0 || count <= 0 || !sourceParent.isValid() || !destinationParent.isValid())
+        return false;
+    Q_ASSERT(sourceParent.model() == this);
+    Q_ASSERT(destinationParent.model() == this);
+    Q_D(Categorizer);
+    const TreeRow* const sourceItem = d->itemForIndex(sourceParent);
+    const TreeRow* const destinationItem = d->itemForIndex(destinationParent);
+    if (!d->isCategory(sourceItem) || !d->isCategory(destinationItem) || sourceItem == destinationItem || sourceRow + count > sourceItem->children().size())
+        return false;
+    QList<QPersistentModelIndex> keyIndexes;
+    keyIndexes.reserve(count);
+    for (int i = sourceRow; i < sourceRow + count; ++i) {
+        const QList<QPersistentModelIndex>& childCols = sourceItem->children().at(i)->columns();
+        Q_ASSERT(d->m_keyColumn < childCols.size());
+        keyIndexes.append(childCols.at(d->m_keyColumn));
+    }
+    QVariantList fromKeys;
+    for (int i = 0; i < count; ++i)
+        fromKeys.append(d->categoryKey(sourceItem));
+    return d->rekeyRows(keyIndexes, fromKeys, d->categoryKey(destinationItem));
 }
 
 bool Categorizer::insertColumns(int column, int count, const QModelIndex &parent) 
@@ -242,11 +474,31 @@ bool Categorizer::insertColumns(int column, int count, const QModelIndex &parent
 
 CategorizerPrivate::~CategorizerPrivate(){
     clearTreeStructure();
+    delete m_storedStructure;
 }
 CategorizerPrivate::CategorizerPrivate(Categorizer* q)
     :q_ptr(q)
     , m_keyColumn(0)
     , m_keyRole(Qt::DisplayRole)
+    , m_bulkRekey(false)
+    , m_normalization(Categorizer::NoNormalization)
+    , m_topCategories(0)
+    , m_categoryThreshold(0)
+    , m_otherLabel(QStringLiteral("Other"))
+    , m_otherCategory(Q_NULLPTR)
+    , m_lazyPopulation(false)
+    , m_fetchBatchSize(256)
+    , m_multiValuedKeys(false)
+    , m_storedStructure(Q_NULLPTR)
+    , m_pushdownRejected(false)
+    , m_snapshotValid(false)
+    , m_sourceDepth(0)
+    , m_sourceResetPending(false)
+    , m_clearRootOnReset(false)
+    , m_keyHashing(UnknownHashing)
+    , m_probingKeyFunctions(false)
+    , m_defaultSameKeyReached(0)
+    , m_defaultKeyHashReached(0)
 {
     Q_ASSERT(q_ptr);
 }
@@ -256,10 +508,8 @@ TreeRow* CategorizerPrivate::itemForIndex(const QModelIndex& idx) const
     if (!idx.isValid())
         return Q_NULLPTR;
     Q_ASSERT(idx.model() == q_ptr);
-    const TreeRow* const internalParent = static_cast<const TreeRow*>(idx.internalPointer());
-    if (internalParent)
-        return internalParent->children().value(idx.row(), Q_NULLPTR);
-    return m_treeStructure.value(idx.row(), Q_NULLPTR);
+    // the internal pointer is the node of the row itself
+    return static_cast<TreeRow*>(idx.internalPointer());
 }
 
 
@@ -268,282 +518,1954 @@ QModelIndex CategorizerPrivate::indexForItem(TreeRow* const item, int col) const
 {
     if (!item || col <0)
         return QModelIndex();
-    TreeRow* const parentItem = item->parent();
-    int rowIdx = -1;
-    if (parentItem)
-        rowIdx = parentItem->children().indexOf(item);
-    else
-        rowIdx = m_treeStructure.indexOf(item);
+    const int rowIdx = rowForItem(item);
     if (rowIdx < 0)
         return QModelIndex();
     Q_Q(const Categorizer);
-    return q->createIndex(rowIdx, col, parentItem);
+    return q->createIndex(rowIdx, col, item);
+}
+
+int CategorizerPrivate::rowForItem(const TreeRow* item) const
+{
+    Q_ASSERT(item);
+    const QList<TreeRow*>& siblings = item->parent() ? item->parent()->children() : m_treeStructure;
+    const int hint = item->rowHint();
+    if (hint >= 0 && hint < siblings.size() && siblings.at(hint) == item)
+        return hint;
+    // the siblings changed since the last lookup, renumber all of them at once
+    const int siblingCount = siblings.size();
+    for (int i = 0; i < siblingCount; ++i)
+        siblings.at(i)->setRowHint(i);
+    // categories not fetched yet are not among the root rows
+    const int row = item->rowHint();
+    return (row >= 0 && row < siblingCount && siblings.at(row) == item) ? row : -1;
+}
+
+bool CategorizerPrivate::isCategory(const TreeRow* item) const
+{
+    return item && item != m_otherCategory && item->columns().isEmpty();
+}
+
+bool CategorizerPrivate::isCategoryLeaf(const TreeRow* item) const
+{
+    return item && !item->columns().isEmpty() && isCategory(item->parent());
+}
+
+QList<TreeRow*> CategorizerPrivate::categories() const
+{
+    if (!otherShown())
+        return m_treeStructure + m_pendingCategories;
+    return m_treeStructure.mid(0, m_treeStructure.size() - 1) + m_otherCategory->children() + m_pendingCategories;
 }
 
 void CategorizerPrivate::clearTreeStructure()
 {
+    invalidateSnapshot();
+    if (m_otherCategory && !otherShown())
+        delete m_otherCategory;
+    m_otherCategory = Q_NULLPTR;
     for (auto i = m_treeStructure.begin(); i != m_treeStructure.end(); ++i)
         delete (*i);
     m_treeStructure.clear();
+    for (auto i = m_pendingCategories.begin(); i != m_pendingCategories.end(); ++i)
+        delete (*i);
+    m_pendingCategories.clear();
+    m_pendingCategorySet.clear();
+    m_rowCategory.clear();
+    m_primaryLeaf.clear();
+    m_extraLeaves.clear();
+    m_groupOffsets.clear();
+    m_groupCategories.clear();
+    m_expectedSizes.clear();
+    m_internedKeys.clear();
+    m_freeKeyIds.clear();
+    m_keyIds.clear();
+    m_rankedCounts.clear();
+    m_visibleRanks.clear();
+    m_foldedRanks.clear();
 }
 
 void CategorizerPrivate::rebuildMapping()
 {
     Q_Q(Categorizer);
-    m_mapping.clear();
-    clearTreeStructure();
+    m_pushdownRejected = false;
     q->beginResetModel();
-    if (q->sourceModel()) {
-        const int rowCnt = q->sourceModel()->rowCount();
-        const int colCnt = q->sourceModel()->columnCount();
-        for (int i = 0; i < rowCnt; ++i) {
-            const QVariant idxData = q->sourceModel()->index(i, m_keyColumn).data(m_keyRole);
-            const int mappingIndex = indexForKey(idxData);
-            TreeRow* catParent = Q_NULLPTR;
-            if (mappingIndex < 0) {
-                catParent = new TreeRow(Q_NULLPTR, 0);
-                catParent->setCategory(idxData);
-                m_treeStructure.append(catParent);
-            }
-            else {
-                catParent = m_treeStructure.at(mappingIndex);
-            }
-            TreeRow* const currItm = new TreeRow(catParent, 0);
-            for (int j = 0; j < colCnt; ++j) {
-                const QPersistentModelIndex currIdx = q->sourceModel()->index(i, j);
-                m_mapping.insert(currIdx, currItm);
-                currItm->columns().append(currIdx);
-                if (q->sourceModel()->hasChildren(currIdx))
-                    rebuildTreeStructure(currIdx, currItm, j);
-            }
-            Q_ASSERT(currItm->columns().size() == colCnt);
-        }
-    }
+    fillMapping();
     q->endResetModel();
 }
 
-void CategorizerPrivate::onSourceRowsInserted(const QModelIndex &parent, int first, int last)
+void CategorizerPrivate::beginSourceReset(bool clearRoot)
 {
     Q_Q(Categorizer);
-    const int colCnt = q->sourceModel()->columnCount(parent);
-    if (!parent.isValid()) {
-        for (int i = first; i <= last; ++i) {
-            const QVariant idxData = q->sourceModel()->index(i, m_keyColumn).data(m_keyRole);
-            const int mappingIndex = indexForKey(idxData);
-            TreeRow* catParent = Q_NULLPTR;
-            if (mappingIndex < 0) {
-                q->beginInsertRows(QModelIndex(), m_treeStructure.size(), m_treeStructure.size());
-                catParent = new TreeRow(Q_NULLPTR, 0);
-                catParent->setCategory(idxData);
-                m_treeStructure.append(catParent);
-                q->endInsertRows();
-            }
-            else {
-                catParent = m_treeStructure.at(mappingIndex);
-            }
-            const int catChildSize = catParent->children().size();
-            int insertIndex = catChildSize;
-            for (int j = 0; j < catChildSize;++j){
-                const QList<QPersistentModelIndex>& columnList = catParent->children().at(j)->columns();
-                Q_ASSERT(!columnList.isEmpty());
-                if (columnList.first().row() >= i) {
-                    insertIndex = j;
-                    break;
+    q->beginResetModel();
+    m_sourceResetPending = true;
+    m_clearRootOnReset = clearRoot;
+}
+
+void CategorizerPrivate::endSourceReset()
+{
+    Q_Q(Categorizer);
+    // like a view, the proxy goes back to the top level rows once its root is gone
+    const bool rootCleared = m_clearRootOnReset;
+    if (rootCleared)
+        m_sourceRoot = QPersistentModelIndex();
+    m_sourceResetPending = false;
+    m_clearRootOnReset = false;
+    m_pushdownRejected = false;
+    fillMapping();
+    q->endResetModel();
+    if (rootCleared)
+        q->sourceRootChanged(QModelIndex());
+}
+
+void CategorizerPrivate::onSourceModelAboutToBeReset()
+{
+    // a reset invalidates the root together with every other index
+    beginSourceReset(m_sourceRoot.isValid());
+}
+
+void CategorizerPrivate::fillMapping()
+{
+    Q_Q(Categorizer);
+    // a stored structure is only used by the first build that has a source
+    StoredStructure* const stored = q->sourceModel() ? m_storedStructure : Q_NULLPTR;
+    if (stored)
+        m_storedStructure = Q_NULLPTR;
+    m_mapping.clear();
+    clearTreeStructure();
+    collectRowParents();
+    if (q->sourceModel()) {
+        const int rowCnt = sourceRowCount();
+        if (lazyEnabled())
+            m_rowCategory.fill(Q_NULLPTR, rowCnt);
+        if (stored && canRestore(*stored)) {
+            restoreCategories(*stored);
+        }
+        else {
+            loadGroups();
+            for (int i = 0; i < rowCnt; ++i) {
+                TreeRow* catParent = groupCategory(i);
+                if (!catParent) {
+                    const QVariant idxData = sourceIndex(i, m_keyColumn).data(m_keyRole);
+                    if (m_multiValuedKeys) {
+                        const QVariantList keys = splitKey(idxData);
+                        TreeRow* primary = Q_NULLPTR;
+                        for (auto k = keys.cbegin(); k != keys.cend(); ++k) {
+                            TreeRow* const keyCat = rootCategoryForKey(*k);
+                            if (primary)
+                                createExtraLeaf(keyCat, primary, keyCat->children().size());
+                            else
+                                primary = createLeaf(keyCat, i, keyCat->children().size());
+                        }
+                        continue;
+                    }
+                    catParent = rootCategoryForKey(idxData);
+                    adjustExpectedSize(catParent, 1);
                 }
+                if (lazyEnabled()) {
+                    // leaves are built when the category gets expanded
+                    catParent->pendingRows().append(i);
+                    m_rowCategory[i] = catParent;
+                    continue;
+                }
+                createLeaf(catParent, i, catParent->children().size());
             }
-            q->beginInsertRows(indexForItem(catParent, 0), insertIndex, insertIndex);
-            TreeRow* const currItm = new TreeRow(catParent, 0);
-            if (insertIndex != catChildSize)
-                catParent->children().move(catChildSize, insertIndex);
-            for (int j = 0; j < colCnt; ++j) {
-                const QPersistentModelIndex currIdx = q->sourceModel()->index(i, j);
-                m_mapping.insert(currIdx, currItm);
-                currItm->columns().append(currIdx);
-                if (q->sourceModel()->hasChildren(currIdx))
-                    rebuildTreeStructure(currIdx, currItm, j);
-            }
-            q->endInsertRows();
+        }
+        if (m_normalization.testFlag(Categorizer::LocaleCollation)) {
+            std::stable_sort(m_treeStructure.begin(), m_treeStructure.end(), [](const TreeRow* left, const TreeRow* right) -> bool {
+                return left->sortKey()->compare(*(right->sortKey())) < 0;
+            });
+        }
+        if (overflowEnabled()) {
+            partitionCategories();
+        }
+        else if (lazyEnabled() && m_fetchBatchSize > 0 && m_treeStructure.size() > m_fetchBatchSize) {
+            m_pendingCategories = m_treeStructure.mid(m_fetchBatchSize);
+            m_pendingCategorySet = QSet<TreeRow*>(m_pendingCategories.cbegin(), m_pendingCategories.cend());
+            m_treeStructure.erase(m_treeStructure.begin() + m_fetchBatchSize, m_treeStructure.end());
         }
     }
-    else{
-        Q_ASSERT(parent.model() == q->sourceModel());
-        const QModelIndex proxyParent = q->mapFromSource(parent);
-        TreeRow* const itemParent = itemForIndex(proxyParent);
-        q->beginInsertRows(proxyParent, first, last);
-        for (int i = first; i <= last; ++i) {
-            TreeRow* const currItm = new TreeRow(itemParent, 0);
-            itemParent->children().move(itemParent->children().size() - 1, i);
-            for (int j = 0; j < colCnt; ++j) {
-                const QPersistentModelIndex currIdx = q->sourceModel()->index(i, j, parent);
-                m_mapping.insert(currIdx, currItm);
-                currItm->columns().append(currIdx);
-                if (q->sourceModel()->hasChildren(currIdx))
-                    rebuildTreeStructure(currIdx, currItm, j);
-            }
+    delete stored;
+}
+
+void CategorizerPrivate::collectRowParents()
+{
+    Q_Q(const Categorizer);
+    m_rowParents.clear();
+    m_parentOrdinals.clear();
+    m_parentOffsets.clear();
+    if (m_sourceDepth == 0 || !q->sourceModel())
+        return;
+    // the levels in between are walked through the first column, like a tree view does
+    QModelIndexList levelParents;
+    levelParents.append(m_sourceRoot);
+    for (int level = 0; level < m_sourceDepth; ++level) {
+        QModelIndexList children;
+        for (auto i = levelParents.cbegin(); i != levelParents.cend(); ++i) {
+            const int rowCnt = q->sourceModel()->rowCount(*i);
+            for (int j = 0; j < rowCnt; ++j)
+                children.append(q->sourceModel()->index(j, 0, *i));
         }
-        q->endInsertRows();
+        levelParents = children;
+    }
+    // the rows under all the parents are numbered one after the other in source order
+    m_rowParents.reserve(levelParents.size());
+    m_parentOffsets.reserve(levelParents.size() + 1);
+    m_parentOffsets.append(0);
+    for (auto i = levelParents.cbegin(); i != levelParents.cend(); ++i) {
+        m_parentOrdinals.insert(*i, m_rowParents.size());
+        m_rowParents.append(*i);
+        m_parentOffsets.append(m_parentOffsets.last() + q->sourceModel()->rowCount(*i));
     }
 }
 
+bool CategorizerPrivate::isCategorizedParent(const QModelIndex& parent) const
+{
+    if (m_sourceDepth == 0)
+        return m_sourceRoot == parent;
+    return m_parentOrdinals.contains(parent);
+}
 
-void CategorizerPrivate::onSourceRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+bool CategorizerPrivate::isAboveRowParents(const QModelIndex& parent) const
 {
-    Q_Q(Categorizer);
-    if(parent.isValid()){
-        Q_ASSERT(parent.model() == q->sourceModel());
-        q->beginRemoveRows(q->mapFromSource(parent), first, last);
+    // rows inserted or removed there change which rows are categorized
+    QModelIndex ancestor = parent;
+    for (int level = 0; level < m_sourceDepth; ++level) {
+        if (ancestor == m_sourceRoot)
+            return true;
+        if (!ancestor.isValid())
+            return false;
+        ancestor = ancestor.parent();
+    }
+    return false;
+}
+
+int CategorizerPrivate::rowOffset(const QModelIndex& parent) const
+{
+    if (m_sourceDepth == 0)
+        return 0;
+    return m_parentOffsets.at(m_parentOrdinals.value(parent));
+}
+
+int CategorizerPrivate::flatRow(const QModelIndex& idx) const
+{
+    if (m_sourceDepth == 0)
+        return idx.row();
+    return m_parentOffsets.at(m_parentOrdinals.value(idx.parent())) + idx.row();
+}
+
+void CategorizerPrivate::shiftRowOffsets(const QModelIndex& parent, int count)
+{
+    if (m_sourceDepth == 0)
         return;
+    const int ordinal = m_parentOrdinals.value(parent);
+    for (auto i = m_parentOffsets.begin() + ordinal + 1; i != m_parentOffsets.end(); ++i)
+        *i += count;
+}
+
+QModelIndex CategorizerPrivate::fetchableParent() const
+{
+    Q_Q(const Categorizer);
+    // rows fetched under a parent at the depth are inserted like any other, the rest come with a reset
+    for (auto i = m_rowParents.cbegin(); i != m_rowParents.cend(); ++i) {
+        if (q->sourceModel()->canFetchMore(*i))
+            return *i;
     }
-    // Since root items for the source model can have different parents in the proxy,
-    // the removal for the proxy needs to be done here
-    QList<int> catToRemove;
-    const int catSize = m_treeStructure.size();
-    for (int catIter = 0; catIter < catSize; ++catIter){ 
-        const int childSize = m_treeStructure.at(catIter)->children().size();
-        QList<int> childrenToRemove;
-        for (int childIter = 0; childIter < childSize; ++childIter){
-            const QList<QPersistentModelIndex>& childCols = m_treeStructure.at(catIter)->children().at(childIter)->columns();
-            Q_ASSERT(!childCols.isEmpty());
-            const int childRow = childCols.first().row();
-            if (childRow >= first && childRow <= last)
-                childrenToRemove << childIter;
-        }
-        if (childrenToRemove.size() == childSize){ //remove entire category
-            catToRemove << catIter;
-        }
-        else{
-            Q_ASSERT(std::is_sorted(childrenToRemove.cbegin(), childrenToRemove.cend()));
-            while (!childrenToRemove.isEmpty()) {
-                int childLast = childrenToRemove.takeLast();
-                int childFirst = childLast;
-                while (!childrenToRemove.isEmpty() && childFirst - childrenToRemove.last() == 1)
-                    childFirst = childrenToRemove.takeLast();
-                q->beginRemoveRows(q->index(catIter, 0), childFirst, childLast);
-                for (; childFirst <= childLast; --childLast) {
-                    TreeRow* itemToRemove = m_treeStructure.at(catIter)->children().takeAt(childLast);
-                    removeFromMapping(itemToRemove);
-                    delete itemToRemove;
-                }
-                q->endRemoveRows();
-            }
-        }
+    return m_sourceRoot;
+}
+
+bool CategorizerPrivate::removesSourceRoot(const QModelIndex& parent, int first, int last) const
+{
+    for (QModelIndex ancestor = m_sourceRoot; ancestor.isValid(); ancestor = ancestor.parent()) {
+        if (ancestor.row() >= first && ancestor.row() <= last && ancestor.parent() == parent)
+            return true;
     }
-    Q_ASSERT(std::is_sorted(catToRemove.cbegin(), catToRemove.cend()));
-    while (!catToRemove.isEmpty()){
-        int catLast = catToRemove.takeLast();
-        int catFirst = catLast;
-        while (!catToRemove.isEmpty() && catFirst - catToRemove.last() == 1)
-            catFirst = catToRemove.takeLast();
-        q->beginRemoveRows(QModelIndex(), catFirst, catLast);
-        for (; catFirst <= catLast; --catLast){
-            TreeRow* itemToRemove = m_treeStructure.takeAt(catLast);
-            removeFromMapping(itemToRemove);
-            delete itemToRemove;
-        }
-        q->endRemoveRows();
+    return false;
+}
+
+QVector<qint32> CategorizerPrivate::sourceRootPath() const
+{
+    QVector<qint32> result;
+    for (QModelIndex ancestor = m_sourceRoot; ancestor.isValid(); ancestor = ancestor.parent())
+        result << ancestor.row() << ancestor.column();
+    return result;
+}
+
+int CategorizerPrivate::sourceRowCount() const
+{
+    Q_Q(const Categorizer);
+    if (!q->sourceModel())
+        return 0;
+    if (m_sourceDepth > 0)
+        return m_parentOffsets.isEmpty() ? 0 : m_parentOffsets.last();
+    return q->sourceModel()->rowCount(m_sourceRoot);
+}
+
+int CategorizerPrivate::sourceColumnCount() const
+{
+    Q_Q(const Categorizer);
+    if (!q->sourceModel())
+        return 0;
+    if (m_sourceDepth > 0)
+        return m_rowParents.isEmpty() ? 0 : q->sourceModel()->columnCount(m_rowParents.first());
+    return q->sourceModel()->columnCount(m_sourceRoot);
+}
+
+QModelIndex CategorizerPrivate::sourceIndex(int row, int column) const
+{
+    Q_Q(const Categorizer);
+    if (m_sourceDepth == 0)
+        return q->sourceModel()->index(row, column, m_sourceRoot);
+    const int ordinal = std::upper_bound(m_parentOffsets.cbegin(), m_parentOffsets.cend(), row) - m_parentOffsets.cbegin() - 1;
+    return q->sourceModel()->index(row - m_parentOffsets.at(ordinal), column, m_rowParents.at(ordinal));
+}
+
+TreeRow* CategorizerPrivate::rootCategoryForKey(const QVariant& key)
+{
+    // only used while resetting the model, every category is still at the root
+    const QString normalized = normalizedKey(key);
+    TreeRow* catParent = findCategory(key, normalized);
+    if (!catParent) {
+        catParent = createCategory(key, normalized);
+        m_treeStructure.append(catParent);
     }
+    return catParent;
 }
 
-void CategorizerPrivate::onSourceRowsRemoved(const QModelIndex &parent, int first, int last)
+bool CategorizerPrivate::pushdownEnabled() const
+{
+    return !m_groupOffsets.isEmpty();
+}
+
+bool CategorizerPrivate::loadGroups()
 {
     Q_Q(Categorizer);
-    if (parent.isValid()) {
-        Q_ASSERT(parent.model() == q->sourceModel());
-        TreeRow* parentItem = itemForIndex(q->mapFromSource(parent));
-        for (; first <= last; --last) {
-            TreeRow* itemToRemove = parentItem->children().takeAt(last);
-            removeFromMapping(itemToRemove);
-            delete itemToRemove;
-        }
-        q->endRemoveRows(); //started in onSourceRowsAboutToBeRemoved
-        return;
+    QVariantList keys;
+    QVector<int> counts;
+    // the counts describe the top level rows of the source
+    if (m_pushdownRejected || m_multiValuedKeys || m_sourceRoot.isValid() || m_sourceDepth > 0 || !q->categoryCounts(keys, counts) || keys.size() != counts.size())
+        return false;
+    m_groupOffsets.reserve(keys.size() + 1);
+    m_groupOffsets.append(0);
+    for (int i = 0; i < keys.size(); ++i) {
+        if (counts.at(i) <= 0)
+            continue;
+        TreeRow* const catParent = rootCategoryForKey(keys.at(i));
+        m_groupCategories.append(catParent);
+        m_groupOffsets.append(m_groupOffsets.last() + counts.at(i));
+        m_expectedSizes[catParent] += counts.at(i);
     }
+    if (groupsMatch(0, sourceRowCount() - 1))
+        return true;
+    // only the categories of the groups exist so far
+    while (!m_treeStructure.isEmpty())
+        destroyCategory(m_treeStructure, m_treeStructure.size() - 1);
+    m_groupOffsets.clear();
+    m_groupCategories.clear();
+    m_expectedSizes.clear();
+    m_pushdownRejected = true;
+    return false;
 }
 
-void CategorizerPrivate::onSourceColumnsAboutToBeInserted(const QModelIndex &parent, int first, int last)
+bool CategorizerPrivate::groupsMatch(int first, int last) const
 {
-    Q_Q(Categorizer);
-    if (parent.isValid()){
-        const QModelIndex proxyParent = q->mapFromSource(parent);
-        q->beginInsertColumns(proxyParent, first, last);
+    if (!pushdownEnabled())
+        return true;
+    // rows are filed by position, the first row of each group shows whether the source is sorted like the counts
+    const int groupCount = m_groupCategories.size();
+    const auto groupsEnd = m_groupOffsets.cbegin() + groupCount;
+    for (auto i = std::lower_bound(m_groupOffsets.cbegin(), groupsEnd, first); i != groupsEnd && *i <= last; ++i) {
+        TreeRow* const groupCat = m_groupCategories.at(i - m_groupOffsets.cbegin());
+        if (!groupCat)
+            continue;
+        const QVariant key = sourceIndex(*i, m_keyColumn).data(m_keyRole);
+        if (!keyMatches(groupCat, key, normalizedKey(key)))
+            return false;
     }
-    else {
-        q->beginInsertColumns(QModelIndex(), first, last);
+    return true;
+}
+
+void CategorizerPrivate::insertGroupRows(int first, int count)
+{
+    if (first >= m_groupOffsets.last())
+        return;
+    // rows inserted between the counted ones get a group of their own without a category, they are filed by key
+    const int group = std::upper_bound(m_groupOffsets.cbegin(), m_groupOffsets.cend(), first) - m_groupOffsets.cbegin() - 1;
+    for (int i = group + 1; i < m_groupOffsets.size(); ++i)
+        m_groupOffsets[i] += count;
+    if (m_groupOffsets.at(group) == first) {
+        m_groupCategories.insert(group, Q_NULLPTR);
+        m_groupOffsets.insert(group + 1, first + count);
+        return;
     }
+    TreeRow* const splitCat = m_groupCategories.at(group);
+    m_groupCategories.insert(group + 1, Q_NULLPTR);
+    m_groupCategories.insert(group + 2, splitCat);
+    m_groupOffsets.insert(group + 1, first);
+    m_groupOffsets.insert(group + 2, first + count);
 }
 
-void CategorizerPrivate::onSourceColumnsInserted(const QModelIndex &parent, int first, int last)
+void CategorizerPrivate::removeGroupRows(int first, int last)
 {
-    Q_Q(Categorizer);
-    if(parent.isValid()){
-        const QModelIndex proxyParent = q->mapFromSource(parent);
-        TreeRow* const parentItem = itemForIndex(proxyParent);
-        Q_ASSERT(parentItem);
-        const int childSize = parentItem->children().size();
-        for (int i = 0; i < childSize; ++i) {
-            for (int j = first; j <= last;++j){
-                parentItem->children().at(i)->columns().insert(j, q->sourceModel()->index(i, j, parent));
-            }
+    const int count = last - first + 1;
+    QVector<int> offsets;
+    QList<TreeRow*> groupCategories;
+    offsets.append(0);
+    for (int i = 0; i < m_groupCategories.size(); ++i) {
+        const int groupEnd = m_groupOffsets.at(i + 1) - qBound(0, m_groupOffsets.at(i + 1) - first, count);
+        if (groupEnd == offsets.last())
+            continue;
+        // groups left next to each other with the same category become one
+        if (!groupCategories.isEmpty() && groupCategories.last() == m_groupCategories.at(i)) {
+            offsets.last() = groupEnd;
+            continue;
         }
-        q->endInsertColumns(); // started in onSourceColumnsAboutToBeInserted
+        groupCategories.append(m_groupCategories.at(i));
+        offsets.append(groupEnd);
     }
-    else {
-        const int catSize = m_treeStructure.size();
-        q->endInsertColumns(); // started in onSourceColumnsAboutToBeInserted
-        // insert within categories
-        for (int catIter = 0; catIter < catSize; ++catIter) {
-            const QModelIndex catParent = q->index(catIter, 0);
-            Q_ASSERT(m_treeStructure.at(catIter)->columns().isEmpty());
-            q->beginInsertColumns(catParent, first, last);
-            const int childSize = m_treeStructure.at(catIter)->children().size();
-            for (int childIter = 0; childIter < childSize; ++childIter) {
-                QList<QPersistentModelIndex>& currColumns = m_treeStructure.at(catIter)->children().at(childIter)->columns();
-                Q_ASSERT(!currColumns.isEmpty());
-                const int currRow = currColumns.first().row();
-                for (int j = first; j <= last; ++j) {
-                    currColumns.insert(j, q->sourceModel()->index(currRow, j, parent));
-                }
-            }
-            q->endInsertColumns();
-        }
-    }    
+    if (groupCategories.isEmpty())
+        offsets.clear();
+    m_groupOffsets = offsets;
+    m_groupCategories = groupCategories;
 }
 
-void CategorizerPrivate::rebuildTreeStructure(const QModelIndex &sourceParent, TreeRow* currParent, int parentCol)
+void CategorizerPrivate::adjustExpectedSize(const TreeRow* category, int delta)
 {
-    Q_Q(const Categorizer);
-    const int rowCnt = q->sourceModel()->rowCount(sourceParent);
-    const int colCnt = q->sourceModel()->columnCount(sourceParent);
-    for (int i = 0; i< rowCnt;++i){
-        TreeRow* const currItm = new TreeRow(currParent, parentCol);
-        for (int j = 0; j < colCnt; ++j) {
-            const QModelIndex currIdx = q->sourceModel()->index(i, j, sourceParent);
-            m_mapping.insert(currIdx, currItm);
-            currItm->columns().append(currIdx);
-            if (q->sourceModel()->hasChildren(currIdx))
-                rebuildTreeStructure(currIdx, currItm, j);
-        }
-        Q_ASSERT(currItm->columns().size() == colCnt);
+    // an expected size counts every row of the category, fetched or not
+    const auto sizeIter = m_expectedSizes.find(category);
+    if (delta == 0 || sizeIter == m_expectedSizes.end())
+        return;
+    *sizeIter += delta;
+    if (*sizeIter <= 0)
+        m_expectedSizes.erase(sizeIter);
+}
+
+void CategorizerPrivate::rejectGroups()
+{
+    Q_Q(Categorizer);
+    // rows already filed by position may be in the wrong category, build everything again from the keys
+    q->beginResetModel();
+    m_pushdownRejected = true;
+    fillMapping();
+    q->endResetModel();
+}
+
+TreeRow* CategorizerPrivate::groupCategory(int sourceRow) const
+{
+    if (!pushdownEnabled() || sourceRow < 0 || sourceRow >= m_groupOffsets.last())
+        return Q_NULLPTR;
+    // the source is sorted by key so every group is a contiguous range of rows
+    const auto groupIter = std::upper_bound(m_groupOffsets.cbegin(), m_groupOffsets.cend(), sourceRow);
+    return m_groupCategories.at(groupIter - m_groupOffsets.cbegin() - 1);
+}
+
+void CategorizerPrivate::invalidateSnapshot()
+{
+    m_snapshotValid = false;
+    m_snapshotRows.clear();
+}
+
+void CategorizerPrivate::invalidateSnapshotOrder()
+{
+    // the rows of each category are still shared by the next snapshot
+    m_snapshotValid = false;
+}
+
+void CategorizerPrivate::invalidateSnapshotRows(const TreeRow* category)
+{
+    m_snapshotValid = false;
+    m_snapshotRows.remove(category);
+}
+
+void CategorizerPrivate::invalidateSnapshotRowsFrom(int sourceRow)
+{
+    // only the categories with rows after the change are renumbered
+    for (auto i = m_snapshotRows.begin(); i != m_snapshotRows.end();) {
+        if (!i->isEmpty() && i->last() >= sourceRow) {
+            i = m_snapshotRows.erase(i);
+            m_snapshotValid = false;
+            continue;
+        }
+        ++i;
+    }
+}
+
+void CategorizerPrivate::onProxyRowsChanged(const QModelIndex& parent)
+{
+    // leaves built from rows already pending don't change the snapshot, their category does it when its rows change
+    if (!parent.isValid() || itemForIndex(parent) == m_otherCategory)
+        invalidateSnapshotOrder();
+}
+
+QVector<int> CategorizerPrivate::snapshotRows(const TreeRow* category) const
+{
+    QVector<int> sourceRows;
+    sourceRows.reserve(category->children().size() + category->pendingRows().size());
+    const QList<TreeRow*>& children = category->children();
+    for (auto j = children.cbegin(); j != children.cend(); ++j)
+        sourceRows.append(flatRow((*j)->columns().first()));
+    // leaves and rows not built yet are both sorted by source row
+    const QVector<int>& pending = category->pendingRows();
+    if (!pending.isEmpty()) {
+        const int childrenEnd = sourceRows.size();
+        sourceRows += pending;
+        std::inplace_merge(sourceRows.begin(), sourceRows.begin() + childrenEnd, sourceRows.end());
+    }
+    return sourceRows;
+}
+
+void CategorizerPrivate::buildSnapshot() const
+{
+    const QList<TreeRow*> allCategories = categories();
+    QVariantList keys;
+    QVector<int> offsets;
+    QVector<QVector<int> > sourceRows;
+    keys.reserve(allCategories.size());
+    offsets.reserve(allCategories.size() + 1);
+    sourceRows.reserve(allCategories.size());
+    offsets.append(0);
+    for (auto i = allCategories.cbegin(); i != allCategories.cend(); ++i) {
+        keys.append(categoryKey(*i));
+        // categories that didn't change since the last snapshot share their rows with it
+        auto rowsIter = m_snapshotRows.find(*i);
+        if (rowsIter == m_snapshotRows.end())
+            rowsIter = m_snapshotRows.insert(*i, snapshotRows(*i));
+        sourceRows.append(rowsIter.value());
+        offsets.append(offsets.last() + rowsIter->size());
+    }
+    m_snapshot = CategorizerSnapshot(keys, offsets, sourceRows);
+    m_snapshotValid = true;
+}
+
+void CategorizerPrivate::fetchSourceRows(TreeRow* category)
+{
+    Q_Q(Categorizer);
+    const int builtSize = category->children().size() + category->pendingRows().size();
+    const int wantedSize = m_fetchBatchSize > 0 ? qMin(categorySize(category), builtSize + m_fetchBatchSize) : categorySize(category);
+    // the source fetches in order, the rows of the category arrive once the ones before them are in
+    const QPersistentModelIndex catIdx = indexForItem(category, 0);
+    while (catIdx.isValid() && q->sourceModel()->canFetchMore(m_sourceRoot)) {
+        TreeRow* const currCategory = itemForIndex(catIdx);
+        if (currCategory->children().size() + currCategory->pendingRows().size() >= wantedSize)
+            break;
+        q->sourceModel()->fetchMore(m_sourceRoot);
+    }
+}
+
+void CategorizerPrivate::restoreCategories(const StoredStructure& stored)
+{
+    const int rowCnt = sourceRowCount();
+    // the source may not have fetched every stored row yet, multi-valued rows still to come are filed by key
+    // so only the categories they use are created, in the stored order
+    const int usedEnd = stored.multiValuedKeys ? (stored.rowOffsets.isEmpty() ? rowCnt : stored.rowOffsets.at(rowCnt)) : stored.rowCategories.size();
+    QVector<bool> usedCategories(stored.keys.size(), false);
+    for (int k = 0; k < usedEnd; ++k)
+        usedCategories[stored.rowCategories.at(k)] = true;
+    QVector<TreeRow*> storedCategories(stored.keys.size(), Q_NULLPTR);
+    for (int i = 0; i < storedCategories.size(); ++i) {
+        if (!usedCategories.at(i))
+            continue;
+        const QVariant& key = stored.keys.at(i);
+        storedCategories[i] = createCategory(key, normalizedKey(key));
+        m_treeStructure.append(storedCategories.at(i));
+    }
+    for (int i = 0; i < rowCnt; ++i) {
+        const int rowFirst = stored.rowOffsets.isEmpty() ? i : stored.rowOffsets.at(i);
+        const int rowLast = stored.rowOffsets.isEmpty() ? i + 1 : stored.rowOffsets.at(i + 1);
+        TreeRow* primary = Q_NULLPTR;
+        for (int k = rowFirst; k < rowLast; ++k) {
+            TreeRow* const catParent = storedCategories.at(stored.rowCategories.at(k));
+            if (primary) {
+                createExtraLeaf(catParent, primary, catParent->children().size());
+            }
+            else if (lazyEnabled()) {
+                catParent->pendingRows().append(i);
+                m_rowCategory[i] = catParent;
+            }
+            else {
+                primary = createLeaf(catParent, i, catParent->children().size());
+            }
+        }
+    }
+    // rows of several categories can't be placed by position, the ones still to come are filed by key
+    if (stored.multiValuedKeys || stored.rowCount == rowCnt)
+        return;
+    // the rows still to come are placed like counted groups, the leading group holds the rows already built
+    m_groupOffsets.append(0);
+    if (rowCnt > 0) {
+        m_groupCategories.append(Q_NULLPTR);
+        m_groupOffsets.append(rowCnt);
+    }
+    for (int i = 0; i < stored.rowCount; ++i) {
+        TreeRow* const catParent = storedCategories.at(stored.rowCategories.at(i));
+        ++m_expectedSizes[catParent];
+        if (i < rowCnt)
+            continue;
+        if (!m_groupCategories.isEmpty() && m_groupCategories.last() == catParent) {
+            ++m_groupOffsets.last();
+            continue;
+        }
+        m_groupCategories.append(catParent);
+        m_groupOffsets.append(i + 1);
+    }
+}
+
+bool CategorizerPrivate::canRestore(const StoredStructure& stored) const
+{
+    // below the top level only the last parent could grow, rows still to come can't be placed
+    return stored.rootPath == sourceRootPath()
+        && stored.sourceDepth == m_sourceDepth
+        && (m_sourceDepth == 0 ? stored.rowCount >= sourceRowCount() : stored.rowCount == sourceRowCount())
+        && stored.keyColumn == m_keyColumn
+        && stored.keyRole == m_keyRole
+        && stored.normalization == static_cast<int>(m_normalization)
+        && stored.multiValuedKeys == m_multiValuedKeys
+        && (!m_normalization.testFlag(Categorizer::LocaleCollation) || stored.collationLocale == m_collator.locale().name())
+        ;
+}
+
+bool CategorizerPrivate::writeStructure(QIODevice* device, quint64 sourceVersion) const
+{
+    const QList<TreeRow*> allCategories = categories();
+    QHash<const TreeRow*, qint32> categoryIndexes;
+    QVariantList keys;
+    keys.reserve(allCategories.size());
+    for (int i = 0; i < allCategories.size(); ++i) {
+        const QVariant key = categoryKey(allCategories.at(i));
+        if (!canSaveKey(key))
+            return false;
+        categoryIndexes.insert(allCategories.at(i), i);
+        keys.append(key);
+    }
+    const int rowCnt = sourceRowCount();
+    QVector<qint32> rowCategories;
+    QVector<qint32> rowOffsets;
+    rowCategories.reserve(rowCnt);
+    for (int i = 0; i < rowCnt; ++i) {
+        if (m_multiValuedKeys)
+            rowOffsets.append(rowCategories.size());
+        TreeRow* const pendingCat = m_rowCategory.value(i, Q_NULLPTR);
+        if (pendingCat) {
+            rowCategories.append(categoryIndexes.value(pendingCat));
+            continue;
+        }
+        TreeRow* const primary = m_mapping.value(sourceIndex(i, 0), Q_NULLPTR);
+        if (!primary || !isCategory(primary->parent()))
+            return false;
+        // the primary category goes first so the restored row owns the same leaf
+        rowCategories.append(categoryIndexes.value(primary->parent()));
+        const QList<TreeRow*> extraLeaves = m_extraLeaves.value(primary);
+        for (auto j = extraLeaves.cbegin(); j != extraLeaves.cend(); ++j)
+            rowCategories.append(categoryIndexes.value((*j)->parent()));
+    }
+    if (m_multiValuedKeys)
+        rowOffsets.append(rowCategories.size());
+    QDataStream stream(device);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << quint32(StructureMagic) << quint16(StructureVersion) << sourceVersion
+        << qint32(m_keyColumn) << qint32(m_keyRole) << static_cast<qint32>(m_normalization) << m_collator.locale().name() << m_multiValuedKeys << sourceRootPath() << qint32(m_sourceDepth)
+        << qint32(rowCnt) << keys << rowCategories;
+    if (m_multiValuedKeys)
+        stream << rowOffsets;
+    return stream.status() == QDataStream::Ok;
+}
+
+bool CategorizerPrivate::canSaveKey(const QVariant& key)
+{
+    if (!key.isValid())
+        return true;
+    // a type without stream operators would write a file that can't be read back
+    QByteArray probe;
+    QDataStream probeStream(&probe, QIODevice::WriteOnly);
+    probeStream.setVersion(QDataStream::Qt_5_6);
+    return QMetaType::save(probeStream, key.userType(), key.constData()) && probeStream.status() == QDataStream::Ok;
+}
+
+bool CategorizerPrivate::readStructure(QIODevice* device, quint64 sourceVersion, StoredStructure& stored) const
+{
+    if (!device || !device->isReadable())
+        return false;
+    QDataStream stream(device);
+    stream.setVersion(QDataStream::Qt_5_6);
+    quint32 magic = 0;
+    quint16 version = 0;
+    quint64 storedSourceVersion = 0;
+    stream >> magic >> version >> storedSourceVersion;
+    if (stream.status() != QDataStream::Ok || magic != StructureMagic || version < 1 || version > StructureVersion || storedSourceVersion != sourceVersion)
+        return false;
+    qint32 keyColumn = 0;
+    qint32 keyRole = 0;
+    qint32 normalization = 0;
+    qint32 rowCount = 0;
+    stream >> keyColumn >> keyRole >> normalization >> stored.collationLocale >> stored.multiValuedKeys;
+    // the first version only stored the top level rows of the source
+    if (version >= 2)
+        stream >> stored.rootPath;
+    qint32 sourceDepth = 0;
+    if (version >= 3)
+        stream >> sourceDepth;
+    stream >> rowCount >> stored.keys >> stored.rowCategories;
+    if (stored.multiValuedKeys)
+        stream >> stored.rowOffsets;
+    if (stream.status() != QDataStream::Ok || rowCount < 0)
+        return false;
+    stored.keyColumn = keyColumn;
+    stored.keyRole = keyRole;
+    stored.normalization = normalization;
+    stored.sourceDepth = sourceDepth;
+    stored.rowCount = rowCount;
+    // the file must describe a consistent structure, every row in at least one category and no empty category
+    if (stored.multiValuedKeys) {
+        if (stored.rowOffsets.size() != rowCount + 1 || stored.rowOffsets.first() != 0 || stored.rowOffsets.last() != stored.rowCategories.size())
+            return false;
+        for (int i = 0; i < rowCount; ++i) {
+            if (stored.rowOffsets.at(i + 1) <= stored.rowOffsets.at(i))
+                return false;
+        }
+    }
+    else if (stored.rowCategories.size() != rowCount) {
+        return false;
+    }
+    QVector<bool> usedCategories(stored.keys.size(), false);
+    for (auto i = stored.rowCategories.cbegin(); i != stored.rowCategories.cend(); ++i) {
+        if (*i < 0 || *i >= stored.keys.size())
+            return false;
+        usedCategories[*i] = true;
+    }
+    return !usedCategories.contains(false);
+}
+
+TreeRow* CategorizerPrivate::createLeaf(TreeRow* category, int sourceRow, int position)
+{
+    Q_Q(Categorizer);
+    const int colCnt = sourceColumnCount();
+    TreeRow* const currItm = new TreeRow(category, 0);
+    const int lastChild = category->children().size() - 1;
+    if (position != lastChild)
+        category->children().move(lastChild, position);
+    for (int j = 0; j < colCnt; ++j) {
+        const QPersistentModelIndex currIdx = sourceIndex(sourceRow, j);
+        m_mapping.insert(currIdx, currItm);
+        currItm->columns().append(currIdx);
+        if (q->sourceModel()->hasChildren(currIdx))
+            rebuildTreeStructure(currIdx, currItm, j);
+    }
+    Q_ASSERT(currItm->columns().size() == colCnt);
+    return currItm;
+}
+
+int CategorizerPrivate::categorySize(const TreeRow* category) const
+{
+    Q_ASSERT(category);
+    const int builtSize = category->children().size() + category->pendingRows().size();
+    if (m_expectedSizes.isEmpty())
+        return builtSize;
+    return qMax(builtSize, m_expectedSizes.value(category, 0));
+}
+
+void CategorizerPrivate::materializeRows(TreeRow* category, const QVector<int>& sourceRows)
+{
+    Q_Q(Categorizer);
+    Q_ASSERT(std::is_sorted(sourceRows.cbegin(), sourceRows.cend()));
+    const QModelIndex catIdx = indexForItem(category, 0);
+    // rows landing between the same two existing children are inserted in one go
+    for (int k = 0; k < sourceRows.size();) {
+        const int insertIndex = childInsertIndex(category, sourceRows.at(k));
+        int runEnd = k + 1;
+        while (runEnd < sourceRows.size() && childInsertIndex(category, sourceRows.at(runEnd)) == insertIndex)
+            ++runEnd;
+        q->beginInsertRows(catIdx, insertIndex, insertIndex + runEnd - k - 1);
+        for (int j = k; j < runEnd; ++j) {
+            createLeaf(category, sourceRows.at(j), insertIndex + j - k);
+            if (lazyEnabled())
+                m_rowCategory[sourceRows.at(j)] = Q_NULLPTR;
+        }
+        q->endInsertRows();
+        k = runEnd;
+    }
+}
+
+void CategorizerPrivate::addPendingRows(TreeRow* category, const QVector<int>& sourceRows)
+{
+    invalidateSnapshotRows(category);
+    QVector<int>& pending = category->pendingRows();
+    for (auto i = sourceRows.cbegin(); i != sourceRows.cend(); ++i) {
+        pending.insert(std::lower_bound(pending.begin(), pending.end(), *i), *i);
+        m_rowCategory[*i] = category;
+    }
+}
+
+void CategorizerPrivate::removePendingRow(TreeRow* category, int sourceRow)
+{
+    invalidateSnapshotRows(category);
+    QVector<int>& pending = category->pendingRows();
+    const auto rowIter = std::lower_bound(pending.begin(), pending.end(), sourceRow);
+    Q_ASSERT(rowIter != pending.end() && *rowIter == sourceRow);
+    pending.erase(rowIter);
+    m_rowCategory[sourceRow] = Q_NULLPTR;
+}
+
+void CategorizerPrivate::shiftPendingRows(int first, int count)
+{
+    m_rowCategory.insert(first, count, Q_NULLPTR);
+    const QList<TreeRow*> allCategories = categories();
+    for (auto catIter = allCategories.cbegin(); catIter != allCategories.cend(); ++catIter) {
+        QVector<int>& pending = (*catIter)->pendingRows();
+        for (auto i = std::lower_bound(pending.begin(), pending.end(), first); i != pending.end(); ++i)
+            *i += count;
+    }
+}
+
+void CategorizerPrivate::demoteToPending(TreeRow* sourceCategory, const QList<TreeRow*>& items, TreeRow* destinationCategory)
+{
+    Q_Q(Categorizer);
+    const QSet<TreeRow*> itemSet = QSet<TreeRow*>(items.cbegin(), items.cend());
+    QList<int> childrenToRemove;
+    const int childSize = sourceCategory->children().size();
+    for (int childIter = 0; childIter < childSize; ++childIter) {
+        if (itemSet.contains(sourceCategory->children().at(childIter)))
+            childrenToRemove << childIter;
+    }
+    QVector<int> sourceRows;
+    sourceRows.reserve(childrenToRemove.size());
+    while (!childrenToRemove.isEmpty()) {
+        int childLast = childrenToRemove.takeLast();
+        int childFirst = childLast;
+        while (!childrenToRemove.isEmpty() && childFirst - childrenToRemove.last() == 1)
+            childFirst = childrenToRemove.takeLast();
+        q->beginRemoveRows(indexForItem(sourceCategory, 0), childFirst, childLast);
+        for (; childFirst <= childLast; --childLast) {
+            TreeRow* const itemToRemove = sourceCategory->children().takeAt(childLast);
+            sourceRows.append(flatRow(itemToRemove->columns().first()));
+            removeFromMapping(itemToRemove);
+            delete itemToRemove;
+        }
+        q->endRemoveRows();
+    }
+    std::sort(sourceRows.begin(), sourceRows.end());
+    addPendingRows(destinationCategory, sourceRows);
+    updateCategoryRank(sourceCategory);
+}
+
+void CategorizerPrivate::fetchCategories(int count)
+{
+    Q_Q(Categorizer);
+    const int fetchCount = count > 0 ? qMin(count, m_pendingCategories.size()) : m_pendingCategories.size();
+    if (fetchCount <= 0)
+        return;
+    if (!m_normalization.testFlag(Categorizer::LocaleCollation)) {
+        q->beginInsertRows(QModelIndex(), m_treeStructure.size(), m_treeStructure.size() + fetchCount - 1);
+        for (int i = 0; i < fetchCount; ++i) {
+            m_pendingCategorySet.remove(m_pendingCategories.first());
+            m_treeStructure.append(m_pendingCategories.takeFirst());
+        }
+        q->endInsertRows();
+        return;
+    }
+    for (int i = 0; i < fetchCount; ++i) {
+        TreeRow* const category = m_pendingCategories.takeFirst();
+        m_pendingCategorySet.remove(category);
+        const int catRow = categoryInsertIndex(m_treeStructure, category);
+        q->beginInsertRows(QModelIndex(), catRow, catRow);
+        m_treeStructure.insert(catRow, category);
+        q->endInsertRows();
+    }
+}
+
+void CategorizerPrivate::fetchLeaves(TreeRow* category, int count)
+{
+    QVector<int>& pending = category->pendingRows();
+    const int fetchCount = count > 0 ? qMin(count, pending.size()) : pending.size();
+    if (fetchCount <= 0)
+        return;
+    const QVector<int> sourceRows = pending.mid(0, fetchCount);
+    pending.remove(0, fetchCount);
+    materializeRows(category, sourceRows);
+}
+
+bool CategorizerPrivate::lazyEnabled() const
+{
+    // pending rows are tracked with a single category per source row
+    return m_lazyPopulation && !m_multiValuedKeys;
+}
+
+bool CategorizerPrivate::isMultiValue(const QVariant& key) const
+{
+    return m_multiValuedKeys && (key.userType() == QMetaType::QVariantList || key.userType() == QMetaType::QStringList);
+}
+
+QVariantList CategorizerPrivate::splitKey(const QVariant& key) const
+{
+    if (!isMultiValue(key))
+        return QVariantList() << key;
+    QVariantList result;
+    const QVariantList values = key.toList();
+    for (auto i = values.cbegin(); i != values.cend(); ++i) {
+        if (std::none_of(result.cbegin(), result.cend(), [this, i](const QVariant& value) -> bool { return sameCategoryKey(value, *i); }))
+            result.append(*i);
+    }
+    // a row without any value still needs a place in the proxy
+    if (result.isEmpty())
+        result.append(QVariant());
+    return result;
+}
+
+bool CategorizerPrivate::sameCategoryKey(const QVariant& left, const QVariant& right) const
+{
+    if (m_normalization != Categorizer::NoNormalization)
+        return normalizedKey(left) == normalizedKey(right);
+    Q_Q(const Categorizer);
+    return q->sameKey(left, right);
+}
+
+QVariant CategorizerPrivate::replaceKey(const QVariant& currentKey, const QVariant& fromKey, const QVariant& toKey) const
+{
+    if (!isMultiValue(currentKey))
+        return toKey;
+    // only the value the row was moved away from is replaced, the other memberships are kept
+    QVariantList values;
+    bool hasToKey = false;
+    const QVariantList currentValues = currentKey.toList();
+    for (auto i = currentValues.cbegin(); i != currentValues.cend(); ++i) {
+        if (sameCategoryKey(*i, fromKey))
+            continue;
+        if (sameCategoryKey(*i, toKey))
+            hasToKey = true;
+        values.append(*i);
+    }
+    if (!hasToKey)
+        values.append(toKey);
+    if (currentKey.userType() != QMetaType::QStringList)
+        return values;
+    QStringList stringValues;
+    for (auto i = values.cbegin(); i != values.cend(); ++i)
+        stringValues.append(i->toString());
+    return stringValues;
+}
+
+TreeRow* CategorizerPrivate::createExtraLeaf(TreeRow* category, TreeRow* primary, int position)
+{
+    Q_ASSERT(category && primary && !primary->columns().isEmpty());
+    // the source indexes are shared with the primary leaf, which alone owns the mapping and the source children
+    TreeRow* const currItm = new TreeRow(category, 0, primary->columns());
+    const int lastChild = category->children().size() - 1;
+    if (position != lastChild)
+        category->children().move(lastChild, position);
+    m_primaryLeaf.insert(currItm, primary);
+    m_extraLeaves[primary].append(currItm);
+    return currItm;
+}
+
+void CategorizerPrivate::removeExtraLeaf(TreeRow* leaf)
+{
+    Q_Q(Categorizer);
+    Q_ASSERT(m_primaryLeaf.contains(leaf));
+    TreeRow* const category = leaf->parent();
+    const int childRow = rowForItem(leaf);
+    Q_ASSERT(childRow >= 0);
+    q->beginRemoveRows(indexForItem(category, 0), childRow, childRow);
+    category->children().removeAt(childRow);
+    removeFromMapping(leaf);
+    delete leaf;
+    q->endRemoveRows();
+    updateCategoryRank(category);
+}
+
+void CategorizerPrivate::insertRowLeaves(int sourceRow, const QVariantList& keys)
+{
+    Q_Q(Categorizer);
+    TreeRow* primary = Q_NULLPTR;
+    for (auto i = keys.cbegin(); i != keys.cend(); ++i) {
+        TreeRow* const catParent = categoryForKey(*i, normalizedKey(*i));
+        const int insertIndex = childInsertIndex(catParent, sourceRow);
+        q->beginInsertRows(indexForItem(catParent, 0), insertIndex, insertIndex);
+        if (primary)
+            createExtraLeaf(catParent, primary, insertIndex);
+        else
+            primary = createLeaf(catParent, sourceRow, insertIndex);
+        q->endInsertRows();
+        updateCategoryRank(catParent);
+    }
+}
+
+void CategorizerPrivate::applyMultiKeyChange(TreeRow* primary, const QVariantList& keys)
+{
+    Q_Q(Categorizer);
+    QList<TreeRow*> addedCategories;
+    for (auto i = keys.cbegin(); i != keys.cend(); ++i) {
+        TreeRow* const category = categoryForKey(*i, normalizedKey(*i));
+        if (!addedCategories.contains(category))
+            addedCategories.append(category);
+    }
+    QList<TreeRow*> keptLeaves;
+    QList<TreeRow*> removedLeaves;
+    const QList<TreeRow*> leaves = QList<TreeRow*>() << primary << m_extraLeaves.value(primary);
+    for (auto i = leaves.cbegin(); i != leaves.cend(); ++i) {
+        if (addedCategories.removeOne((*i)->parent()))
+            keptLeaves.append(*i);
+        else
+            removedLeaves.append(*i);
+    }
+    // the primary leaf is moved rather than removed so the mapping and the source children stay where they are
+    if (removedLeaves.removeOne(primary)) {
+        TreeRow* destinationCat = Q_NULLPTR;
+        if (addedCategories.isEmpty()) {
+            Q_ASSERT(!keptLeaves.isEmpty());
+            destinationCat = keptLeaves.first()->parent();
+            removeExtraLeaf(keptLeaves.first());
+        }
+        else {
+            destinationCat = addedCategories.takeFirst();
+        }
+        moveToCategory(primary->parent(), QList<TreeRow*>() << primary, destinationCat);
+    }
+    while (!removedLeaves.isEmpty() && !addedCategories.isEmpty()) {
+        TreeRow* const leaf = removedLeaves.takeFirst();
+        moveToCategory(leaf->parent(), QList<TreeRow*>() << leaf, addedCategories.takeFirst());
+    }
+    for (auto i = removedLeaves.cbegin(); i != removedLeaves.cend(); ++i)
+        removeExtraLeaf(*i);
+    const int sourceRow = flatRow(primary->columns().first());
+    for (auto i = addedCategories.cbegin(); i != addedCategories.cend(); ++i) {
+        const int insertIndex = childInsertIndex(*i, sourceRow);
+        q->beginInsertRows(indexForItem(*i, 0), insertIndex, insertIndex);
+        createExtraLeaf(*i, primary, insertIndex);
+        q->endInsertRows();
+        updateCategoryRank(*i);
+    }
+}
+
+void CategorizerPrivate::forwardDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles)
+{
+    Q_Q(Categorizer);
+    if (!topLeft.isValid() || !bottomRight.isValid())
+        return;
+    const QModelIndex proxyTopLeft = q->mapFromSource(topLeft);
+    // one signal is enough only if every row of the range sits right below the previous one in the same parent
+    bool contiguous = proxyTopLeft.isValid();
+    const TreeRow* const firstItem = contiguous ? itemForIndex(proxyTopLeft) : Q_NULLPTR;
+    for (int i = topLeft.row() + 1; contiguous && i <= bottomRight.row(); ++i) {
+        const TreeRow* const currItem = m_mapping.value(topLeft.sibling(i, topLeft.column()), Q_NULLPTR);
+        contiguous = currItem && currItem->parent() == firstItem->parent() && rowForItem(currItem) == proxyTopLeft.row() + i - topLeft.row();
+    }
+    if (contiguous) {
+        q->dataChanged(proxyTopLeft, proxyTopLeft.sibling(proxyTopLeft.row() + bottomRight.row() - topLeft.row(), bottomRight.column()), roles);
+    }
+    else {
+        // the rows are scattered across categories or not built yet
+        const int bottomRow = bottomRight.row();
+        for (int i = topLeft.row(); i <= bottomRow; ++i) {
+            const QModelIndex rowLeft = q->mapFromSource(topLeft.sibling(i, topLeft.column()));
+            if (rowLeft.isValid())
+                q->dataChanged(rowLeft, rowLeft.sibling(rowLeft.row(), bottomRight.column()), roles);
+        }
+    }
+    if (m_extraLeaves.isEmpty() || !isCategorizedParent(topLeft.parent()))
+        return;
+    // rows in several categories are shown once per extra leaf too
+    const int bottomRow = bottomRight.row();
+    for (int i = topLeft.row(); i <= bottomRow; ++i) {
+        const QList<TreeRow*> extraLeaves = m_extraLeaves.value(m_mapping.value(topLeft.sibling(i, topLeft.column()), Q_NULLPTR));
+        for (auto j = extraLeaves.cbegin(); j != extraLeaves.cend(); ++j) {
+            const QModelIndex rowLeft = indexForItem(*j, topLeft.column());
+            q->dataChanged(rowLeft, rowLeft.sibling(rowLeft.row(), bottomRight.column()), roles);
+        }
+    }
+}
+
+void CategorizerPrivate::onSourceRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_Q(Categorizer);
+    const int colCnt = q->sourceModel()->columnCount(parent);
+    if (isCategorizedParent(parent)) {
+        // rows under every parent at the depth are numbered together
+        shiftRowOffsets(parent, last - first + 1);
+        const int offset = rowOffset(parent);
+        first += offset;
+        last += offset;
+        invalidateSnapshotRowsFrom(first);
+        // counted groups only describe rows appended in order, like a source fetching more
+        if (pushdownEnabled() && last != sourceRowCount() - 1)
+            insertGroupRows(first, last - first + 1);
+        if (!groupsMatch(first, last)) {
+            rejectGroups();
+            return;
+        }
+        if (lazyEnabled())
+            shiftPendingRows(first, last - first + 1);
+        QList<TreeRow*> insertCategories;
+        QHash<TreeRow*, QVector<int> > rowsByCategory;
+        for (int i = first; i <= last; ++i) {
+            TreeRow* catParent = groupCategory(i);
+            if (!catParent) {
+                const QVariant idxData = sourceIndex(i, m_keyColumn).data(m_keyRole);
+                if (m_multiValuedKeys) {
+                    insertRowLeaves(i, splitKey(idxData));
+                    continue;
+                }
+                catParent = categoryForKey(idxData, normalizedKey(idxData));
+                adjustExpectedSize(catParent, 1);
+            }
+            if (!rowsByCategory.contains(catParent))
+                insertCategories.append(catParent);
+            rowsByCategory[catParent].append(i);
+        }
+        // a batch is inserted with one signal for each run of rows landing together in a category
+        for (auto i = insertCategories.cbegin(); i != insertCategories.cend(); ++i) {
+            if (m_pendingCategorySet.contains(*i))
+                addPendingRows(*i, rowsByCategory.value(*i));
+            else
+                materializeRows(*i, rowsByCategory.value(*i));
+            updateCategoryRank(*i);
+        }
+    }
+    else if (isAboveRowParents(parent)) {
+        // the parents at the depth changed
+        rebuildMapping();
+    }
+    else{
+        Q_ASSERT(!parent.isValid() || parent.model() == q->sourceModel());
+        const QModelIndex proxyParent = q->mapFromSource(parent);
+        TreeRow* const itemParent = itemForIndex(proxyParent);
+        if (!itemParent)
+            return;
+        q->beginInsertRows(proxyParent, first, last);
+        for (int i = first; i <= last; ++i) {
+            TreeRow* const currItm = new TreeRow(itemParent, 0);
+            itemParent->children().move(itemParent->children().size() - 1, i);
+            for (int j = 0; j < colCnt; ++j) {
+                const QPersistentModelIndex currIdx = q->sourceModel()->index(i, j, parent);
+                m_mapping.insert(currIdx, currItm);
+                currItm->columns().append(currIdx);
+                if (q->sourceModel()->hasChildren(currIdx))
+                    rebuildTreeStructure(currIdx, currItm, j);
+            }
+        }
+        q->endInsertRows();
+    }
+}
+
+
+void CategorizerPrivate::onSourceRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+{
+    Q_Q(Categorizer);
+    if (removesSourceRoot(parent, first, last)) {
+        // finished in onSourceRowsRemoved once the root is gone
+        beginSourceReset(true);
+        return;
+    }
+    if (isAboveRowParents(parent)) {
+        // finished in onSourceRowsRemoved once the parents at the depth are gone
+        beginSourceReset(false);
+        return;
+    }
+    if (!isCategorizedParent(parent)) {
+        Q_ASSERT(!parent.isValid() || parent.model() == q->sourceModel());
+        const QModelIndex proxyParent = q->mapFromSource(parent);
+        // the parent may not be built yet or be outside the root
+        if (proxyParent.isValid())
+            q->beginRemoveRows(proxyParent, first, last);
+        return;
+    }
+    // Since rows under the source root can have different parents in the proxy,
+    // the removal for the proxy needs to be done here
+    const int offset = rowOffset(parent);
+    first += offset;
+    last += offset;
+    invalidateSnapshotRowsFrom(first);
+    QSet<TreeRow*> catToRemove;
+    QList<TreeRow*> catChanged;
+    const QList<TreeRow*> allCategories = categories();
+    for (auto catIter = allCategories.cbegin(); catIter != allCategories.cend(); ++catIter){ 
+        TreeRow* const category = *catIter;
+        const int childSize = category->children().size();
+        QList<int> childrenToRemove;
+        for (int childIter = 0; childIter < childSize; ++childIter){
+            const QList<QPersistentModelIndex>& childCols = category->children().at(childIter)->columns();
+            Q_ASSERT(!childCols.isEmpty());
+            const int childRow = flatRow(childCols.first());
+            if (childRow >= first && childRow <= last)
+                childrenToRemove << childIter;
+        }
+        // rows not built yet only need renumbering
+        QVector<int>& pending = category->pendingRows();
+        const auto pendingFirst = std::lower_bound(pending.begin(), pending.end(), first);
+        const auto pendingLast = std::upper_bound(pendingFirst, pending.end(), last);
+        const int pendingToRemove = pendingLast - pendingFirst;
+        adjustExpectedSize(category, -childrenToRemove.size() - pendingToRemove);
+        if (childrenToRemove.size() == childSize && pendingToRemove == pending.size() && !m_expectedSizes.contains(category)){ //remove entire category
+            catToRemove.insert(category);
+            continue;
+        }
+        for (auto i = pendingLast; i != pending.end(); ++i)
+            *i -= last - first + 1;
+        if (pendingToRemove > 0) {
+            pending.erase(pendingFirst, pendingLast);
+            catChanged << category;
+        }
+        if (!childrenToRemove.isEmpty()) {
+            Q_ASSERT(std::is_sorted(childrenToRemove.cbegin(), childrenToRemove.cend()));
+            while (!childrenToRemove.isEmpty()) {
+                int childLast = childrenToRemove.takeLast();
+                int childFirst = childLast;
+                while (!childrenToRemove.isEmpty() && childFirst - childrenToRemove.last() == 1)
+                    childFirst = childrenToRemove.takeLast();
+                q->beginRemoveRows(indexForItem(category, 0), childFirst, childLast);
+                for (; childFirst <= childLast; --childLast) {
+                    TreeRow* itemToRemove = category->children().takeAt(childLast);
+                    removeFromMapping(itemToRemove);
+                    delete itemToRemove;
+                }
+                q->endRemoveRows();
+            }
+            if (pendingToRemove == 0)
+                catChanged << category;
+        }
+    }
+    if (lazyEnabled())
+        m_rowCategory.remove(first, last - first + 1);
+    for (auto catIter = catChanged.cbegin(); catIter != catChanged.cend(); ++catIter)
+        updateCategoryRank(*catIter);
+    removeCategories(catToRemove);
+}
+
+void CategorizerPrivate::onSourceRowsRemoved(const QModelIndex &parent, int first, int last)
+{
+    Q_Q(Categorizer);
+    if (m_sourceResetPending) {
+        endSourceReset();
+        return;
+    }
+    if (!isCategorizedParent(parent)) {
+        Q_ASSERT(!parent.isValid() || parent.model() == q->sourceModel());
+        TreeRow* parentItem = itemForIndex(q->mapFromSource(parent));
+        if (!parentItem)
+            return;
+        for (; first <= last; --last) {
+            TreeRow* itemToRemove = parentItem->children().takeAt(last);
+            removeFromMapping(itemToRemove);
+            delete itemToRemove;
+        }
+        q->endRemoveRows(); //started in onSourceRowsAboutToBeRemoved
+        return;
+    }
+    shiftRowOffsets(parent, first - last - 1);
+    // the counted groups shift together with the rows
+    if (pushdownEnabled())
+        removeGroupRows(first, last);
+}
+
+void CategorizerPrivate::onSourceColumnsAboutToBeInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_Q(Categorizer);
+    if (m_sourceDepth > 0 && (isAboveRowParents(parent) || isCategorizedParent(parent))) {
+        // the parents at the depth are found through the first column, finished in onSourceColumnsInserted
+        beginSourceReset(false);
+        return;
+    }
+    if (!isCategorizedParent(parent)){
+        const QModelIndex proxyParent = q->mapFromSource(parent);
+        if (proxyParent.isValid())
+            q->beginInsertColumns(proxyParent, first, last);
+    }
+    else {
+        q->beginInsertColumns(QModelIndex(), first, last);
+    }
+}
+
+void CategorizerPrivate::onSourceColumnsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_Q(Categorizer);
+    if (m_sourceResetPending) {
+        endSourceReset();
+        return;
+    }
+    if (!isCategorizedParent(parent)) {
+        const QModelIndex proxyParent = q->mapFromSource(parent);
+        TreeRow* const parentItem = itemForIndex(proxyParent);
+        if (!parentItem)
+            return;
+        const int childSize = parentItem->children().size();
+        for (int i = 0; i < childSize; ++i) {
+            for (int j = first; j <= last;++j){
+                parentItem->children().at(i)->columns().insert(j, q->sourceModel()->index(i, j, parent));
+            }
+        }
+        q->endInsertColumns(); // started in onSourceColumnsAboutToBeInserted
+    }
+    else {
+        q->endInsertColumns(); // started in onSourceColumnsAboutToBeInserted
+        if (otherShown()) {
+            q->beginInsertColumns(indexForItem(m_otherCategory, 0), first, last);
+            q->endInsertColumns();
+        }
+        // insert within categories
+        const QList<TreeRow*> allCategories = categories();
+        for (auto catIter = allCategories.cbegin(); catIter != allCategories.cend(); ++catIter) {
+            TreeRow* const category = *catIter;
+            Q_ASSERT(category->columns().isEmpty());
+            // categories not fetched yet have no index and no leaves
+            if (m_pendingCategorySet.contains(category))
+                continue;
+            q->beginInsertColumns(indexForItem(category, 0), first, last);
+            const int childSize = category->children().size();
+            for (int childIter = 0; childIter < childSize; ++childIter) {
+                QList<QPersistentModelIndex>& currColumns = category->children().at(childIter)->columns();
+                Q_ASSERT(!currColumns.isEmpty());
+                const int currRow = currColumns.first().row();
+                for (int j = first; j <= last; ++j) {
+                    currColumns.insert(j, q->sourceModel()->index(currRow, j, parent));
+                }
+            }
+            q->endInsertColumns();
+        }
+    }    
+}
+
+void CategorizerPrivate::rebuildTreeStructure(const QModelIndex &sourceParent, TreeRow* currParent, int parentCol)
+{
+    Q_Q(const Categorizer);
+    const int rowCnt = q->sourceModel()->rowCount(sourceParent);
+    const int colCnt = q->sourceModel()->columnCount(sourceParent);
+    for (int i = 0; i< rowCnt;++i){
+        TreeRow* const currItm = new TreeRow(currParent, parentCol);
+        for (int j = 0; j < colCnt; ++j) {
+            const QModelIndex currIdx = q->sourceModel()->index(i, j, sourceParent);
+            m_mapping.insert(currIdx, currItm);
+            currItm->columns().append(currIdx);
+            if (q->sourceModel()->hasChildren(currIdx))
+                rebuildTreeStructure(currIdx, currItm, j);
+        }
+        Q_ASSERT(currItm->columns().size() == colCnt);
+    }
+}
+
+QString CategorizerPrivate::normalizedKey(const QVariant& key) const
+{
+    if (m_normalization == Categorizer::NoNormalization)
+        return QString();
+    QString result = key.toString();
+    if (m_normalization.testFlag(Categorizer::TrimWhitespace))
+        result = result.trimmed();
+    if (m_normalization.testFlag(Categorizer::UnicodeNormalization))
+        result = result.normalized(QString::NormalizationForm_KC);
+    if (m_normalization.testFlag(Categorizer::CaseFolding))
+        result = result.toCaseFolded();
+    return result;
+}
+
+uint CategorizerPrivate::internedHash(const QVariant& key, const QString& normalized) const
+{
+    if (m_normalization != Categorizer::NoNormalization)
+        return qHash(normalized);
+    Q_Q(const Categorizer);
+    return q->keyHash(key);
+}
+
+bool CategorizerPrivate::keyHashTrusted() const
+{
+    if (m_keyHashing == UnknownHashing) {
+        Q_Q(const Categorizer);
+        // the default implementations count when they are reached, the default hash only agrees with the default sameKey().
+        // A reimplementation handing some types to the base one counts as reimplemented
+        const QVariantList probes{QVariant(), QVariant(QStringLiteral("a")), QVariant(1)};
+        m_probingKeyFunctions = true;
+        m_defaultSameKeyReached = 0;
+        m_defaultKeyHashReached = 0;
+        for (auto i = probes.cbegin(); i != probes.cend(); ++i) {
+            q->sameKey(*i, *i);
+            q->keyHash(*i);
+        }
+        m_probingKeyFunctions = false;
+        const bool defaultSameKey = m_defaultSameKeyReached == probes.size();
+        const bool defaultKeyHash = m_defaultKeyHashReached > 0;
+        m_keyHashing = (defaultSameKey || !defaultKeyHash) ? TrustedHashing : ScanHashing;
+    }
+    return m_keyHashing == TrustedHashing;
+}
+
+int CategorizerPrivate::keyId(const QVariant& key, const QString& normalized) const
+{
+    Q_Q(const Categorizer);
+    const uint hash = internedHash(key, normalized);
+    for (auto i = m_keyIds.constFind(hash); i != m_keyIds.cend() && i.key() == hash; ++i) {
+        const InternedKey& interned = m_internedKeys.at(i.value());
+        if (m_normalization != Categorizer::NoNormalization ? interned.normalized == normalized : q->sameKey(interned.key, key))
+            return i.value();
+    }
+    if (m_normalization != Categorizer::NoNormalization || keyHashTrusted())
+        return -1;
+    // sameKey() was reimplemented without keyHash(), keys in other buckets can still match
+    for (int i = 0; i < m_internedKeys.size(); ++i) {
+        const InternedKey& interned = m_internedKeys.at(i);
+        if (interned.category && interned.hash != hash && q->sameKey(interned.key, key))
+            return i;
+    }
+    return -1;
+}
+
+int CategorizerPrivate::internKey(const QVariant& key, const QString& normalized, TreeRow* category)
+{
+    int id = m_internedKeys.size();
+    if (m_freeKeyIds.isEmpty())
+        m_internedKeys.append(InternedKey());
+    else
+        id = m_freeKeyIds.takeLast();
+    InternedKey& interned = m_internedKeys[id];
+    interned.key = key;
+    interned.normalized = normalized;
+    interned.hash = internedHash(key, normalized);
+    interned.category = category;
+    m_keyIds.insert(interned.hash, id);
+    return id;
+}
+
+void CategorizerPrivate::releaseKey(int id)
+{
+    if (id < 0)
+        return;
+    InternedKey& interned = m_internedKeys[id];
+    m_keyIds.remove(interned.hash, id);
+    interned = InternedKey();
+    m_freeKeyIds.append(id);
+}
+
+QVariant CategorizerPrivate::categoryKey(const TreeRow* category) const
+{
+    Q_ASSERT(category);
+    if (category->keyId() < 0)
+        return QVariant();
+    return m_internedKeys.at(category->keyId()).key;
+}
+
+bool CategorizerPrivate::keyMatches(const TreeRow* category, const QVariant& key, const QString& normalized) const
+{
+    Q_ASSERT(category);
+    const int id = keyId(key, normalized);
+    return id >= 0 && id == category->keyId();
+}
+
+TreeRow* CategorizerPrivate::findCategory(const QVariant& key, const QString& normalized) const
+{
+    const int id = keyId(key, normalized);
+    return id >= 0 ? m_internedKeys.at(id).category : Q_NULLPTR;
+}
+
+TreeRow* CategorizerPrivate::createCategory(const QVariant& key, const QString& normalized)
+{
+    TreeRow* const catParent = new TreeRow(Q_NULLPTR, 0);
+    catParent->setKeyId(internKey(key, normalized, catParent));
+    if (m_normalization.testFlag(Categorizer::LocaleCollation))
+        catParent->setSortKey(m_collator.sortKey(normalized));
+    return catParent;
+}
+
+int CategorizerPrivate::categoryInsertIndex(const QList<TreeRow*>& siblings, const TreeRow* category) const
+{
+    // the overflow category is always the last root row
+    const int siblingCount = (&siblings == &m_treeStructure && otherShown()) ? siblings.size() - 1 : siblings.size();
+    if (!m_normalization.testFlag(Categorizer::LocaleCollation))
+        return siblingCount;
+    Q_ASSERT(category->sortKey());
+    const auto insertIter = std::upper_bound(siblings.cbegin(), siblings.cbegin() + siblingCount, category, [](const TreeRow* left, const TreeRow* right) -> bool {
+        return left->sortKey()->compare(*(right->sortKey())) < 0;
+    });
+    return insertIter - siblings.cbegin();
+}
+
+TreeRow* CategorizerPrivate::categoryForKey(const QVariant& key, const QString& normalized)
+{
+    TreeRow* const existingCat = findCategory(key, normalized);
+    if (existingCat)
+        return existingCat;
+    Q_Q(Categorizer);
+    TreeRow* const catParent = createCategory(key, normalized);
+    if (!m_pendingCategories.isEmpty()) {
+        // the root is still being fetched, the new category will come after the ones already known
+        m_pendingCategories.append(catParent);
+        m_pendingCategorySet.insert(catParent);
+    }
+    else if (shouldShowNewCategory()) {
+        const int catRow = categoryInsertIndex(m_treeStructure, catParent);
+        q->beginInsertRows(QModelIndex(), catRow, catRow);
+        m_treeStructure.insert(catRow, catParent);
+        q->endInsertRows();
+        if (overflowEnabled())
+            m_visibleRanks.insert(std::make_pair(0, catParent));
+    }
+    else {
+        showOther();
+        const int catRow = categoryInsertIndex(m_otherCategory->children(), catParent);
+        q->beginInsertRows(indexForItem(m_otherCategory, 0), catRow, catRow);
+        catParent->setParent(m_otherCategory);
+        m_otherCategory->children().insert(catRow, catParent);
+        q->endInsertRows();
+        m_foldedRanks.insert(std::make_pair(0, catParent));
+    }
+    if (overflowEnabled())
+        m_rankedCounts.insert(catParent, 0);
+    return catParent;
+}
+
+void CategorizerPrivate::destroyCategory(QList<TreeRow*>& siblings, int catRow)
+{
+    TreeRow* const category = siblings.takeAt(catRow);
+    releaseKey(category->keyId());
+    invalidateSnapshotRows(category);
+    m_expectedSizes.remove(category);
+    // the rows of its groups, if any are left, get filed by key
+    std::replace(m_groupCategories.begin(), m_groupCategories.end(), category, static_cast<TreeRow*>(Q_NULLPTR));
+    if (overflowEnabled()) {
+        const int rankedCount = m_rankedCounts.take(category);
+        m_visibleRanks.erase(std::make_pair(rankedCount, category));
+        m_foldedRanks.erase(std::make_pair(rankedCount, category));
+    }
+    delete category;
+}
+
+bool CategorizerPrivate::overflowEnabled() const
+{
+    return m_topCategories > 0 || m_categoryThreshold > 0;
+}
+
+bool CategorizerPrivate::otherShown() const
+{
+    return m_otherCategory && !m_treeStructure.isEmpty() && m_treeStructure.last() == m_otherCategory;
+}
+
+void CategorizerPrivate::showOther()
+{
+    Q_ASSERT(m_otherCategory);
+    if (otherShown())
+        return;
+    Q_Q(Categorizer);
+    q->beginInsertRows(QModelIndex(), m_treeStructure.size(), m_treeStructure.size());
+    m_treeStructure.append(m_otherCategory);
+    q->endInsertRows();
+}
+
+void CategorizerPrivate::hideOtherIfEmpty()
+{
+    if (!otherShown() || !m_otherCategory->children().isEmpty())
+        return;
+    Q_Q(Categorizer);
+    q->beginRemoveRows(QModelIndex(), m_treeStructure.size() - 1, m_treeStructure.size() - 1);
+    m_treeStructure.removeLast();
+    q->endRemoveRows();
+}
+
+bool CategorizerPrivate::shouldShowNewCategory() const
+{
+    if (!overflowEnabled())
+        return true;
+    // a new category is empty, it's visible only if there is no threshold and there is room at the top
+    return m_categoryThreshold <= 0 && (m_topCategories <= 0 || static_cast<int>(m_visibleRanks.size()) < m_topCategories);
+}
+
+void CategorizerPrivate::updateCategoryRank(TreeRow* category)
+{
+    // called whenever rows join or leave the category
+    invalidateSnapshotRows(category);
+    // empty categories are about to be removed
+    const int newCount = categorySize(category);
+    if (!overflowEnabled() || newCount == 0)
+        return;
+    const int oldCount = m_rankedCounts.value(category);
+    if (oldCount == newCount)
+        return;
+    m_rankedCounts[category] = newCount;
+    std::set<std::pair<int, TreeRow*> >& ranks = category->parent() ? m_foldedRanks : m_visibleRanks;
+    ranks.erase(std::make_pair(oldCount, category));
+    ranks.insert(std::make_pair(newCount, category));
+    rebalanceCategories();
+}
+
+void CategorizerPrivate::foldCategory(TreeRow* category)
+{
+    Q_Q(Categorizer);
+    Q_ASSERT(!category->parent());
+    showOther();
+    const int catRow = rowForItem(category);
+    const int destinationRow = categoryInsertIndex(m_otherCategory->children(), category);
+    q->beginMoveRows(QModelIndex(), catRow, catRow, indexForItem(m_otherCategory, 0), destinationRow);
+    m_treeStructure.removeAt(catRow);
+    category->setParent(m_otherCategory);
+    m_otherCategory->children().insert(destinationRow, category);
+    q->endMoveRows();
+    const std::pair<int, TreeRow*> rank(m_rankedCounts.value(category), category);
+    m_visibleRanks.erase(rank);
+    m_foldedRanks.insert(rank);
+}
+
+void CategorizerPrivate::promoteCategory(TreeRow* category)
+{
+    Q_Q(Categorizer);
+    Q_ASSERT(category->parent() == m_otherCategory);
+    const int catRow = rowForItem(category);
+    const int destinationRow = categoryInsertIndex(m_treeStructure, category);
+    q->beginMoveRows(indexForItem(m_otherCategory, 0), catRow, catRow, QModelIndex(), destinationRow);
+    m_otherCategory->children().removeAt(catRow);
+    category->setParent(Q_NULLPTR);
+    m_treeStructure.insert(destinationRow, category);
+    q->endMoveRows();
+    const std::pair<int, TreeRow*> rank(m_rankedCounts.value(category), category);
+    m_foldedRanks.erase(rank);
+    m_visibleRanks.insert(rank);
+    hideOtherIfEmpty();
+}
+
+void CategorizerPrivate::rebalanceCategories()
+{
+    if (!overflowEnabled())
+        return;
+    for (;;) {
+        if (!m_visibleRanks.empty()) {
+            const std::pair<int, TreeRow*> smallestVisible = *m_visibleRanks.begin();
+            if (smallestVisible.first < m_categoryThreshold || (m_topCategories > 0 && static_cast<int>(m_visibleRanks.size()) > m_topCategories)) {
+                foldCategory(smallestVisible.second);
+                continue;
+            }
+        }
+        if (m_foldedRanks.empty())
+            break;
+        const std::pair<int, TreeRow*> largestFolded = *m_foldedRanks.rbegin();
+        if (largestFolded.first < m_categoryThreshold)
+            break;
+        if (m_topCategories <= 0 || static_cast<int>(m_visibleRanks.size()) < m_topCategories) {
+            promoteCategory(largestFolded.second);
+            continue;
+        }
+        if (largestFolded.first > m_visibleRanks.begin()->first) {
+            foldCategory(m_visibleRanks.begin()->second);
+            promoteCategory(largestFolded.second);
+            continue;
+        }
+        break;
+    }
+}
+
+void CategorizerPrivate::partitionCategories()
+{
+    // only called while resetting the model, every category is still at the root
+    QList<TreeRow*> byCount = m_treeStructure;
+    std::stable_sort(byCount.begin(), byCount.end(), [this](const TreeRow* left, const TreeRow* right) -> bool {
+        return categorySize(left) > categorySize(right);
+    });
+    QSet<TreeRow*> visibleSet;
+    for (auto i = byCount.cbegin(); i != byCount.cend(); ++i) {
+        if ((m_topCategories > 0 && visibleSet.size() >= m_topCategories) || categorySize(*i) < m_categoryThreshold)
+            break;
+        visibleSet.insert(*i);
+    }
+    m_otherCategory = new TreeRow(Q_NULLPTR, 0);
+    QList<TreeRow*> rootRows;
+    for (auto i = m_treeStructure.cbegin(); i != m_treeStructure.cend(); ++i) {
+        const int count = categorySize(*i);
+        m_rankedCounts.insert(*i, count);
+        if (visibleSet.contains(*i)) {
+            rootRows.append(*i);
+            m_visibleRanks.insert(std::make_pair(count, *i));
+        }
+        else {
+            (*i)->setParent(m_otherCategory);
+            m_otherCategory->children().append(*i);
+            m_foldedRanks.insert(std::make_pair(count, *i));
+        }
+    }
+    m_treeStructure = rootRows;
+    if (!m_otherCategory->children().isEmpty())
+        m_treeStructure.append(m_otherCategory);
+}
+
+int CategorizerPrivate::childInsertIndex(const TreeRow* category, int sourceRow) const
+{
+    Q_ASSERT(category);
+    const auto insertIter = std::lower_bound(category->children().cbegin(), category->children().cend(), sourceRow, [this](const TreeRow* item, int row) -> bool {
+        Q_ASSERT(!item->columns().isEmpty());
+        return flatRow(item->columns().first()) < row;
+    });
+    return insertIter - category->children().cbegin();
+}
+
+void CategorizerPrivate::moveToCategory(TreeRow* sourceCategory, const QList<TreeRow*>& items, TreeRow* destinationCategory)
+{
+    Q_Q(Categorizer);
+    Q_ASSERT(sourceCategory && destinationCategory && sourceCategory != destinationCategory);
+    const QSet<TreeRow*> itemSet = QSet<TreeRow*>(items.cbegin(), items.cend());
+    QList<int> childrenToMove;
+    const int childSize = sourceCategory->children().size();
+    for (int childIter = 0; childIter < childSize; ++childIter) {
+        if (itemSet.contains(sourceCategory->children().at(childIter)))
+            childrenToMove << childIter;
+    }
+    // move contiguous blocks that land next to each other, starting from the bottom so the rows above stay valid
+    while (!childrenToMove.isEmpty()) {
+        int childLast = childrenToMove.takeLast();
+        int childFirst = childLast;
+        const int insertIndex = childInsertIndex(destinationCategory, flatRow(sourceCategory->children().at(childLast)->columns().first()));
+        while (!childrenToMove.isEmpty() && childFirst - childrenToMove.last() == 1
+            && childInsertIndex(destinationCategory, flatRow(sourceCategory->children().at(childrenToMove.last())->columns().first())) == insertIndex
+        ) {
+            childFirst = childrenToMove.takeLast();
+        }
+        q->beginMoveRows(indexForItem(sourceCategory, 0), childFirst, childLast, indexForItem(destinationCategory, 0), insertIndex);
+        for (int i = childLast; i >= childFirst; --i) {
+            TreeRow* const movedItem = sourceCategory->children().takeAt(i);
+            movedItem->setParent(destinationCategory);
+            destinationCategory->children().insert(insertIndex, movedItem);
+        }
+        q->endMoveRows();
+    }
+    updateCategoryRank(sourceCategory);
+    updateCategoryRank(destinationCategory);
+}
+
+void CategorizerPrivate::removeCategories(const QSet<TreeRow*>& categoriesToRemove)
+{
+    if (categoriesToRemove.isEmpty())
+        return;
+    Q_Q(Categorizer);
+    // categories not fetched yet go away silently
+    for (int catIter = m_pendingCategories.size() - 1; catIter >= 0; --catIter) {
+        if (!categoriesToRemove.contains(m_pendingCategories.at(catIter)))
+            continue;
+        m_pendingCategorySet.remove(m_pendingCategories.at(catIter));
+        destroyCategory(m_pendingCategories, catIter);
+    }
+    QList<TreeRow*> parentItems;
+    if (otherShown())
+        parentItems << m_otherCategory;
+    parentItems << Q_NULLPTR;
+    for (auto parIter = parentItems.cbegin(); parIter != parentItems.cend(); ++parIter) {
+        QList<TreeRow*>& siblings = *parIter ? (*parIter)->children() : m_treeStructure;
+        QList<int> catToRemove;
+        const int catSize = siblings.size();
+        for (int catIter = 0; catIter < catSize; ++catIter) {
+            if (categoriesToRemove.contains(siblings.at(catIter)))
+                catToRemove << catIter;
+        }
+        while (!catToRemove.isEmpty()) {
+            int catLast = catToRemove.takeLast();
+            int catFirst = catLast;
+            while (!catToRemove.isEmpty() && catFirst - catToRemove.last() == 1)
+                catFirst = catToRemove.takeLast();
+            q->beginRemoveRows(indexForItem(*parIter, 0), catFirst, catLast);
+            for (; catFirst <= catLast; --catLast) {
+                removeFromMapping(siblings.at(catLast));
+                destroyCategory(siblings, catLast);
+            }
+            q->endRemoveRows();
+        }
+    }
+    hideOtherIfEmpty();
+    rebalanceCategories();
+}
+
+void CategorizerPrivate::removeEmptyCategories()
+{
+    QSet<TreeRow*> catToRemove;
+    const QList<TreeRow*> allCategories = categories();
+    for (auto catIter = allCategories.cbegin(); catIter != allCategories.cend(); ++catIter) {
+        if (categorySize(*catIter) == 0)
+            catToRemove.insert(*catIter);
+    }
+    removeCategories(catToRemove);
+}
+
+void CategorizerPrivate::applyKeyChanges(const QList<QPersistentModelIndex>& keyIndexes)
+{
+    if (m_multiValuedKeys) {
+        for (auto i = keyIndexes.cbegin(); i != keyIndexes.cend(); ++i) {
+            if (!i->isValid())
+                continue;
+            TreeRow* const proxyItem = m_mapping.value(*i, Q_NULLPTR);
+            if (!proxyItem)
+                continue;
+            Q_ASSERT(isCategory(proxyItem->parent()));
+            applyMultiKeyChange(proxyItem, splitKey(i->data(m_keyRole)));
+        }
+        removeEmptyCategories();
+        return;
+    }
+    QList<TreeRow*> changedItems;
+    QList<QVariant> changedKeys;
+    QStringList changedNormalized;
+    QVector<int> changedIds;
+    QList<TreeRow*> pendingSources;
+    QList<TreeRow*> pendingDestinations;
+    QHash<TreeRow*, QVector<int> > pendingByDestination;
+    for (auto i = keyIndexes.cbegin(); i != keyIndexes.cend(); ++i) {
+        if (!i->isValid())
+            continue;
+        TreeRow* const proxyItem = m_mapping.value(*i, Q_NULLPTR);
+        if (!proxyItem) {
+            // rows not built yet only change the category they are pending in
+            if (!isCategorizedParent(i->parent()))
+                continue;
+            const int sourceRow = flatRow(*i);
+            TreeRow* const pendingCat = m_rowCategory.value(sourceRow, Q_NULLPTR);
+            if (!pendingCat)
+                continue;
+            const QVariant newData = i->data(m_keyRole);
+            const QString normalized = normalizedKey(newData);
+            if (keyMatches(pendingCat, newData, normalized))
+                continue;
+            TreeRow* const destinationCat = categoryForKey(newData, normalized);
+            removePendingRow(pendingCat, sourceRow);
+            adjustExpectedSize(pendingCat, -1);
+            adjustExpectedSize(destinationCat, 1);
+            if (!pendingSources.contains(pendingCat))
+                pendingSources.append(pendingCat);
+            if (!pendingByDestination.contains(destinationCat))
+                pendingDestinations.append(destinationCat);
+            pendingByDestination[destinationCat].append(sourceRow);
+            continue;
+        }
+        Q_ASSERT(isCategory(proxyItem->parent()));
+        const QVariant newData = i->data(m_keyRole);
+        const QString normalized = normalizedKey(newData);
+        if (keyMatches(proxyItem->parent(), newData, normalized))
+            continue;
+        changedItems.append(proxyItem);
+        changedKeys.append(newData);
+        changedNormalized.append(normalized);
+        changedIds.append(keyId(newData, normalized));
+    }
+    while (!changedItems.isEmpty()) {
+        TreeRow* const destinationCat = categoryForKey(changedKeys.first(), changedNormalized.first());
+        QList<TreeRow*> sourceCats;
+        QHash<TreeRow*, QList<TreeRow*> > itemsBySource;
+        for (int i = 0; i < changedItems.size();) {
+            // keys of categories created by a previous pass were not interned when the change was read
+            if (changedIds.at(i) < 0)
+                changedIds[i] = keyId(changedKeys.at(i), changedNormalized.at(i));
+            if (changedIds.at(i) != destinationCat->keyId()) {
+                ++i;
+                continue;
+            }
+            TreeRow* const proxyItem = changedItems.takeAt(i);
+            changedKeys.removeAt(i);
+            changedNormalized.removeAt(i);
+            changedIds.removeAt(i);
+            if (!itemsBySource.contains(proxyItem->parent()))
+                sourceCats.append(proxyItem->parent());
+            itemsBySource[proxyItem->parent()].append(proxyItem);
+        }
+        for (auto i = sourceCats.cbegin(); i != sourceCats.cend(); ++i) {
+            const int movedCount = itemsBySource.value(*i).size();
+            adjustExpectedSize(*i, -movedCount);
+            adjustExpectedSize(destinationCat, movedCount);
+            if (m_pendingCategorySet.contains(destinationCat))
+                demoteToPending(*i, itemsBySource.value(*i), destinationCat);
+            else
+                moveToCategory(*i, itemsBySource.value(*i), destinationCat);
+        }
+    }
+    for (auto i = pendingDestinations.cbegin(); i != pendingDestinations.cend(); ++i) {
+        QVector<int> sourceRows = pendingByDestination.value(*i);
+        std::sort(sourceRows.begin(), sourceRows.end());
+        if (m_pendingCategorySet.contains(*i))
+            addPendingRows(*i, sourceRows);
+        else
+            materializeRows(*i, sourceRows);
+        updateCategoryRank(*i);
+    }
+    for (auto i = pendingSources.cbegin(); i != pendingSources.cend(); ++i)
+        updateCategoryRank(*i);
+    removeEmptyCategories();
+}
+
+bool CategorizerPrivate::rekeyRows(const QList<QPersistentModelIndex>& keyIndexes, const QVariantList& fromKeys, const QVariant& key)
+{
+    Q_Q(Categorizer);
+    bool result = true;
+    // collect all the changes and apply them as grouped moves once the source is done
+    m_bulkRekey = true;
+    for (int i = 0; i < keyIndexes.size(); ++i) {
+        const QPersistentModelIndex& keyIdx = keyIndexes.at(i);
+        if (keyIdx.isValid())
+            result = q->sourceModel()->setData(keyIdx, replaceKey(keyIdx.data(m_keyRole), fromKeys.value(i), key), m_keyRole) && result;
+    }
+    m_bulkRekey = false;
+    // the source may have changed the keys of other rows while setting these
+    QList<QPersistentModelIndex> changedKeys = keyIndexes;
+    QSet<QPersistentModelIndex> seenKeys(keyIndexes.cbegin(), keyIndexes.cend());
+    for (auto i = m_bulkChangedKeys.cbegin(); i != m_bulkChangedKeys.cend(); ++i) {
+        if (seenKeys.contains(*i))
+            continue;
+        seenKeys.insert(*i);
+        changedKeys.append(*i);
     }
+    m_bulkChangedKeys.clear();
+    applyKeyChanges(changedKeys);
+    return result;
+}
+
+TreeRow* CategorizerPrivate::dropCategory(const QModelIndex& parent) const
+{
+    TreeRow* const parentItem = itemForIndex(parent);
+    if (isCategory(parentItem))
+        return parentItem;
+    if (isCategoryLeaf(parentItem))
+        return parentItem->parent();
+    return Q_NULLPTR;
 }
 
-int CategorizerPrivate::indexForKey(const QVariant& key) const
+QList<QPersistentModelIndex> CategorizerPrivate::decodeRows(const QMimeData* data, QVariantList* fromKeys) const
 {
     Q_Q(const Categorizer);
-    const int treeSize = m_treeStructure.size();
-    for (int i = 0; i < treeSize; ++i) {
-        if (q->sameKey(m_treeStructure.at(i)->category(), key))
-            return i;
+    QList<QPersistentModelIndex> result;
+    if (!data || !q->sourceModel() || !data->hasFormat(rowsMimeType()))
+        return result;
+    QByteArray encoded = data->data(rowsMimeType());
+    QDataStream stream(&encoded, QIODevice::ReadOnly);
+    quintptr origin = 0;
+    QList<int> sourceRows;
+    QList<qint32> sourceKeyIds;
+    stream >> origin >> sourceRows >> sourceKeyIds;
+    if (stream.status() != QDataStream::Ok || origin != reinterpret_cast<quintptr>(q) || sourceKeyIds.size() != sourceRows.size())
+        return result;
+    const int rowCnt = sourceRowCount();
+    for (int i = 0; i < sourceRows.size(); ++i) {
+        if (sourceRows.at(i) < 0 || sourceRows.at(i) >= rowCnt)
+            continue;
+        result.append(sourceIndex(sourceRows.at(i), m_keyColumn));
+        if (!fromKeys)
+            continue;
+        // the category the row was dragged from may have been removed since
+        const int id = sourceKeyIds.at(i);
+        const bool liveKey = id >= 0 && id < m_internedKeys.size() && m_internedKeys.at(id).category;
+        fromKeys->append(liveKey ? m_internedKeys.at(id).key : QVariant());
     }
-    return -1;
+    return result;
 }
 
 
 void CategorizerPrivate::removeFromMapping(TreeRow* item)
 {
+    const auto primaryIter = m_primaryLeaf.find(item);
+    if (primaryIter != m_primaryLeaf.end()) {
+        // extra leaves don't own the mapping of their source indexes
+        const auto extraIter = m_extraLeaves.find(primaryIter.value());
+        if (extraIter != m_extraLeaves.end()) {
+            extraIter->removeOne(item);
+            if (extraIter->isEmpty())
+                m_extraLeaves.erase(extraIter);
+        }
+        m_primaryLeaf.erase(primaryIter);
+        return;
+    }
+    if (!m_extraLeaves.isEmpty()) {
+        const QList<TreeRow*> extraLeaves = m_extraLeaves.take(item);
+        for (auto i = extraLeaves.cbegin(); i != extraLeaves.cend(); ++i)
+            m_primaryLeaf.remove(*i);
+    }
     const auto colEnd = item->columns().cend();
-    for (auto i = item->columns().cbegin(); i != colEnd; ++i)
-        m_mapping.remove(*i);
+    for (auto i = item->columns().cbegin(); i != colEnd; ++i) {
+        const auto mappingIter = m_mapping.find(*i);
+        if (mappingIter != m_mapping.end() && mappingIter.value() == item)
+            m_mapping.erase(mappingIter);
+    }
     const auto childEnd = item->children().end();
     for (auto i = item->children().begin(); i != childEnd; ++i)
         removeFromMapping(*i);
@@ -558,56 +2480,20 @@ void CategorizerPrivate::onSourceDataChanged(const QModelIndex& topLeft, const Q
     Q_ASSERT(bottomRight.model() == q->sourceModel());
     const QModelIndex& sourceParent = topLeft.parent();
     Q_ASSERT(sourceParent == bottomRight.parent());
-    if (topLeft.parent().isValid())
+    if (!isCategorizedParent(sourceParent))
         return;
     if (!((roles.isEmpty() || roles.contains(m_keyRole)) && topLeft.column() <= m_keyColumn && bottomRight.column() >= m_keyColumn))
         return;
     const int bottomRow = bottomRight.row();
-    for (int i = topLeft.row(); i <= bottomRow;++i){
-        const QModelIndex proxyIdx = q->mapFromSource(q->sourceModel()->index(i, m_keyColumn, sourceParent));
-        Q_ASSERT(proxyIdx.isValid());
-        const int catRow = proxyIdx.parent().row();
-        Q_ASSERT(catRow >= 0);
-        const QVariant& newData = proxyIdx.data();
-        if (q->sameKey(m_treeStructure.at(catRow)->category(), newData))
-            continue;
-        const int destinationRow = indexForKey(newData);
-        TreeRow* destinationCat = Q_NULLPTR;
-        if(destinationRow<0){
-            q->beginInsertRows(QModelIndex(), m_treeStructure.size(), m_treeStructure.size());
-            destinationCat = new TreeRow(Q_NULLPTR, 0);
-            destinationCat->setCategory(newData);
-            m_treeStructure.append(destinationCat);
-            q->endInsertRows();
-        }
-        else {
-            destinationCat = m_treeStructure.at(destinationRow);
-        }
-        const int catChildSize = destinationCat->children().size();
-        int insertIndex = catChildSize;
-        for (int j = 0; j < catChildSize; ++j) {
-            const QList<QPersistentModelIndex>& columnList = destinationCat->children().at(j)->columns();
-            Q_ASSERT(!columnList.isEmpty());
-            if (columnList.first().row() >= i) {
-                insertIndex = j;
-                break;
-            }
-        }
-        q->beginMoveRows(proxyIdx.parent(), proxyIdx.row(), proxyIdx.row(), q->index(destinationRow, 0), insertIndex);
-        TreeRow* const proxyItem = itemForIndex(proxyIdx);
-        TreeRow* const oldParentItem = proxyItem->parent();
-        Q_ASSERT(oldParentItem);
-        Q_ASSERT(!oldParentItem->parent());
-        oldParentItem->children().removeAll(proxyItem);
-        proxyItem->setParent(destinationCat);
-        destinationCat->children().insert(insertIndex,proxyItem);
-        q->endMoveRows();
-        if(oldParentItem->children().isEmpty()){
-            q->beginRemoveRows(QModelIndex(), catRow, catRow);
-            delete m_treeStructure.takeAt(catRow);
-            q->endRemoveRows();
-        }
-    }
+    QList<QPersistentModelIndex> keyIndexes;
+    keyIndexes.reserve(bottomRow - topLeft.row() + 1);
+    for (int i = topLeft.row(); i <= bottomRow; ++i)
+        keyIndexes.append(q->sourceModel()->index(i, m_keyColumn, sourceParent));
+    // changes during a bulk re-key are applied together with it
+    if (m_bulkRekey)
+        m_bulkChangedKeys += keyIndexes;
+    else
+        applyKeyChanges(keyIndexes);
 }
 
 
@@ -617,7 +2503,11 @@ Categorizer::Categorizer(QObject* parent)
     :QAbstractProxyModel(parent)
     , m_dptr(new CategorizerPrivate(this))
 {
-
+    connect(this, &QAbstractItemModel::modelReset, this, std::bind(&CategorizerPrivate::invalidateSnapshot, m_dptr));
+    connect(this, &QAbstractItemModel::layoutChanged, this, std::bind(&CategorizerPrivate::invalidateSnapshotOrder, m_dptr));
+    connect(this, &QAbstractItemModel::rowsInserted, this, std::bind(&CategorizerPrivate::onProxyRowsChanged, m_dptr, std::placeholders::_1));
+    connect(this, &QAbstractItemModel::rowsRemoved, this, std::bind(&CategorizerPrivate::onProxyRowsChanged, m_dptr, std::placeholders::_1));
+    connect(this, &QAbstractItemModel::rowsMoved, this, std::bind(&CategorizerPrivate::invalidateSnapshotOrder, m_dptr));
 }
 
 Categorizer::~Categorizer()
@@ -634,22 +2524,29 @@ void Categorizer::setSourceModel(QAbstractItemModel* newSourceModel)
             QObject::disconnect(*discIter);
     }
     d->m_sourceConnections.clear();
+    // the root only makes sense inside the model it comes from
+    const bool resetRoot = d->m_sourceRoot.isValid() && d->m_sourceRoot.model() != newSourceModel;
+    if (resetRoot)
+        d->m_sourceRoot = QPersistentModelIndex();
     QAbstractProxyModel::setSourceModel(newSourceModel);
     d->rebuildMapping();
+    if (resetRoot)
+        sourceRootChanged(QModelIndex());
     if (sourceModel()) {
         d->m_sourceConnections
-            << connect(sourceModel(), &QAbstractItemModel::modelAboutToBeReset, this, &QAbstractItemModel::modelAboutToBeReset)
-            << connect(sourceModel(), &QAbstractItemModel::modelReset, this, std::bind(&CategorizerPrivate::rebuildMapping, d))
+            << connect(sourceModel(), &QAbstractItemModel::modelAboutToBeReset, this, std::bind(&CategorizerPrivate::onSourceModelAboutToBeReset, d))
+            << connect(sourceModel(), &QAbstractItemModel::modelReset, this, std::bind(&CategorizerPrivate::endSourceReset, d))
             << connect(sourceModel(), &QAbstractItemModel::dataChanged, this, std::bind(&CategorizerPrivate::onSourceDataChanged, d, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3))
             << connect(sourceModel(), &QAbstractItemModel::rowsInserted, this, std::bind(&CategorizerPrivate::onSourceRowsInserted, d, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3))
             << connect(sourceModel(), &QAbstractItemModel::columnsInserted, this, std::bind(&CategorizerPrivate::onSourceColumnsInserted, d, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3))
             << connect(sourceModel(), &QAbstractItemModel::columnsAboutToBeInserted, this, std::bind(&CategorizerPrivate::onSourceColumnsAboutToBeInserted, d, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3))
             << connect(sourceModel(), &QAbstractItemModel::rowsRemoved, this, std::bind(&CategorizerPrivate::onSourceRowsRemoved, d, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3))
             << connect(sourceModel(), &QAbstractItemModel::rowsAboutToBeRemoved, this, std::bind(&CategorizerPrivate::onSourceRowsAboutToBeRemoved, d, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3))
-            << connect(sourceModel(), &QAbstractItemModel::dataChanged, this, [this](const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles) {
-                dataChanged(mapFromSource(topLeft), mapFromSource(bottomRight), roles);
-            })
+            << connect(sourceModel(), &QAbstractItemModel::dataChanged, this, std::bind(&CategorizerPrivate::forwardDataChanged, d, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3))
             << connect(sourceModel(), &QAbstractItemModel::headerDataChanged, this, &QAbstractItemModel::headerDataChanged)
+            // the source row numbers stored in a snapshot move without the proxy following them
+            << connect(sourceModel(), &QAbstractItemModel::rowsMoved, this, std::bind(&CategorizerPrivate::invalidateSnapshot, d))
+            << connect(sourceModel(), &QAbstractItemModel::layoutChanged, this, std::bind(&CategorizerPrivate::invalidateSnapshot, d))
             ;
     }
     Q_ASSERT(std::all_of(d->m_sourceConnections.cbegin(), d->m_sourceConnections.cend(), [](const QMetaObject::Connection &connection)->bool {return connection; }));
@@ -670,8 +2567,13 @@ bool Categorizer::hasChildren(const QModelIndex &parent) const
     if (!parent.isValid())
         return d->m_treeStructure.size()>0;
     Q_ASSERT(parent.model() == this);
-    if (!parent.parent().isValid())
+    const TreeRow* const parentItem = d->itemForIndex(parent);
+    if (!parentItem)
+        return false;
+    if (parentItem->columns().isEmpty())
         return parent.column()==0;
+    if (d->m_primaryLeaf.contains(parentItem))
+        return false;
     return sourceModel()->hasChildren(mapToSource(parent));
 }
 
@@ -695,8 +2597,12 @@ int Categorizer::columnCount(const QModelIndex &parent) const
 {
     if (!sourceModel())
         return 0;
-    if (!parent.isValid() || !parent.parent().isValid())
-        return sourceModel()->columnCount();
+    Q_D(const Categorizer);
+    if (!parent.isValid())
+        return d->sourceColumnCount();
+    const TreeRow* const parentItem = d->itemForIndex(parent);
+    if (!parentItem || parentItem->columns().isEmpty())
+        return d->sourceColumnCount();
     return sourceModel()->columnCount(mapToSource(parent));
 }
 
@@ -718,24 +2624,29 @@ QVariant Categorizer::data(const QModelIndex &proxyIndex, int role) const
 {
     if (!proxyIndex.isValid() || !sourceModel())
         return QVariant();
-    if (!proxyIndex.parent().isValid()){
+    Q_D(const Categorizer);
+    const TreeRow* const item = d->itemForIndex(proxyIndex);
+    if (!item)
+        return QVariant();
+    if (item->columns().isEmpty())
         return dataForRoot(proxyIndex, role);
-    }
     return sourceModel()->data(mapToSource(proxyIndex), role);
 }
 
 bool Categorizer::setData(const QModelIndex &index, const QVariant &value, int role)
 {
-    if (!sourceModel() || !index.isValid() || !index.parent().isValid())
+    const QModelIndex sourceIndex = mapToSource(index);
+    if (!sourceIndex.isValid())
         return false;
-    return sourceModel()->setData(mapToSource(index), value, role);
+    return sourceModel()->setData(sourceIndex, value, role);
 }
 
 bool Categorizer::setItemData(const QModelIndex &index, const QMap<int, QVariant> &roles)
 {
-    if (!sourceModel() || !index.isValid() || !index.parent().isValid())
+    const QModelIndex sourceIndex = mapToSource(index);
+    if (!sourceIndex.isValid())
         return false;
-    return sourceModel()->setItemData(mapToSource(index), roles);
+    return sourceModel()->setItemData(sourceIndex, roles);
 }
 
 
@@ -752,21 +2663,31 @@ QModelIndex Categorizer::mapFromSource(const QModelIndex &sourceIndex) const
 
 QModelIndex Categorizer::mapToSource(const QModelIndex &proxyIndex) const 
 {
-    if (!proxyIndex.isValid() || !sourceModel() || !proxyIndex.parent().isValid())
+    if (!proxyIndex.isValid() || !sourceModel())
         return QModelIndex();
     Q_ASSERT(proxyIndex.model() == this);
     Q_D(const Categorizer);
     const TreeRow* const itemIdx = d->itemForIndex(proxyIndex);
-    if (!itemIdx)
+    if (!itemIdx || itemIdx->columns().isEmpty())
         return QModelIndex();
     return itemIdx->columns().value(proxyIndex.column(), QPersistentModelIndex());
 }
 
 Qt::ItemFlags Categorizer::flags(const QModelIndex &index) const 
 {
-    if (!sourceModel() || !index.isValid() || !index.parent().isValid())
+    if (!sourceModel() || !index.isValid())
+        return Qt::ItemIsEnabled;
+    Q_D(const Categorizer);
+    const TreeRow* const item = d->itemForIndex(index);
+    if (d->isCategory(item))
+        return Qt::ItemIsEnabled | Qt::ItemIsDropEnabled;
+    if (!item || item->columns().isEmpty())
         return Qt::ItemIsEnabled;
-    return sourceModel()->flags(mapToSource(index));
+    const Qt::ItemFlags sourceFlags = sourceModel()->flags(mapToSource(index));
+    // moving a row to another category writes its key, a read only key can't be moved
+    if (d->isCategoryLeaf(item) && sourceModel()->flags(item->columns().value(d->m_keyColumn)).testFlag(Qt::ItemIsEditable))
+        return sourceFlags | Qt::ItemIsDragEnabled | Qt::ItemIsDropEnabled;
+    return sourceFlags;
 }
 
 QModelIndex Categorizer::parent(const QModelIndex &index) const
@@ -808,6 +2729,87 @@ bool Categorizer::moveColumns(const QModelIndex &sourceParent, int sourceColumn,
     return result;*/
 }
 
+Qt::DropActions Categorizer::supportedDragActions() const
+{
+    return Qt::MoveAction;
+}
+
+Qt::DropActions Categorizer::supportedDropActions() const
+{
+    return Qt::MoveAction;
+}
+
+QStringList Categorizer::mimeTypes() const
+{
+    return QStringList(CategorizerPrivate::rowsMimeType());
+}
+
+QMimeData* Categorizer::mimeData(const QModelIndexList &indexes) const
+{
+    if (!sourceModel())
+        return Q_NULLPTR;
+    Q_D(const Categorizer);
+    QList<int> sourceRows;
+    QList<const TreeRow*> sourceCategories;
+    QList<qint32> sourceKeyIds;
+    for (auto i = indexes.cbegin(); i != indexes.cend(); ++i) {
+        if (!i->isValid())
+            continue;
+        Q_ASSERT(i->model() == this);
+        const TreeRow* const item = d->itemForIndex(*i);
+        if (!d->isCategoryLeaf(item))
+            continue;
+        const QModelIndex sourceIdx = mapToSource(*i);
+        if (!sourceIdx.isValid())
+            continue;
+        const int sourceRow = d->flatRow(sourceIdx);
+        // the same row can be dragged out of each category it belongs to
+        bool duplicate = false;
+        for (int j = 0; !duplicate && j < sourceRows.size(); ++j)
+            duplicate = sourceRows.at(j) == sourceRow && sourceCategories.at(j) == item->parent();
+        if (duplicate)
+            continue;
+        sourceRows.append(sourceRow);
+        sourceCategories.append(item->parent());
+        sourceKeyIds.append(item->parent()->keyId());
+    }
+    if (sourceRows.isEmpty())
+        return Q_NULLPTR;
+    QByteArray encoded;
+    QDataStream stream(&encoded, QIODevice::WriteOnly);
+    // categories travel as interned ids, arbitrary keys may not be streamable
+    stream << reinterpret_cast<quintptr>(this) << sourceRows << sourceKeyIds;
+    QMimeData* const result = new QMimeData;
+    result->setData(CategorizerPrivate::rowsMimeType(), encoded);
+    return result;
+}
+
+bool Categorizer::canDropMimeData(const QMimeData *data, Qt::DropAction action, int row, int column, const QModelIndex &parent) const
+{
+    Q_UNUSED(row)
+    Q_UNUSED(column)
+    if (!sourceModel() || !data || action != Qt::MoveAction || !data->hasFormat(CategorizerPrivate::rowsMimeType()))
+        return false;
+    Q_D(const Categorizer);
+    return d->dropCategory(parent) != Q_NULLPTR;
+}
+
+bool Categorizer::dropMimeData(const QMimeData *data, Qt::DropAction action, int row, int column, const QModelIndex &parent)
+{
+    if (action == Qt::IgnoreAction)
+        return true;
+    if (!canDropMimeData(data, action, row, column, parent))
+        return false;
+    Q_D(Categorizer);
+    QVariantList fromKeys;
+    const QList<QPersistentModelIndex> keyIndexes = d->decodeRows(data, &fromKeys);
+    if (keyIndexes.isEmpty())
+        return false;
+    d->rekeyRows(keyIndexes, fromKeys, d->categoryKey(d->dropCategory(parent)));
+    // the rows have already been moved, returning true would make QAbstractItemView remove them from the source
+    return false;
+}
+
 int Categorizer::keyColumn() const
 {
     Q_D(const Categorizer);
@@ -840,20 +2842,347 @@ void Categorizer::setKeyRole(int role)
     d->rebuildMapping();
 }
 
+Categorizer::KeyNormalization Categorizer::keyNormalization() const
+{
+    Q_D(const Categorizer);
+    return d->m_normalization;
+}
+
+void Categorizer::setKeyNormalization(KeyNormalization normalization)
+{
+    Q_D(Categorizer);
+    if (d->m_normalization == normalization)
+        return;
+    d->m_normalization = normalization;
+    keyNormalizationChanged(normalization);
+    d->rebuildMapping();
+}
+
+QLocale Categorizer::collationLocale() const
+{
+    Q_D(const Categorizer);
+    return d->m_collator.locale();
+}
+
+void Categorizer::setCollationLocale(const QLocale& locale)
+{
+    Q_D(Categorizer);
+    if (d->m_collator.locale() == locale)
+        return;
+    d->m_collator.setLocale(locale);
+    collationLocaleChanged(locale);
+    if (d->m_normalization.testFlag(LocaleCollation))
+        d->rebuildMapping();
+}
+
+int Categorizer::topCategories() const
+{
+    Q_D(const Categorizer);
+    return d->m_topCategories;
+}
+
+void Categorizer::setTopCategories(int count)
+{
+    Q_D(Categorizer);
+    count = qMax(0, count);
+    if (d->m_topCategories == count)
+        return;
+    d->m_topCategories = count;
+    topCategoriesChanged(count);
+    d->rebuildMapping();
+}
+
+int Categorizer::categoryThreshold() const
+{
+    Q_D(const Categorizer);
+    return d->m_categoryThreshold;
+}
+
+void Categorizer::setCategoryThreshold(int count)
+{
+    Q_D(Categorizer);
+    count = qMax(0, count);
+    if (d->m_categoryThreshold == count)
+        return;
+    d->m_categoryThreshold = count;
+    categoryThresholdChanged(count);
+    d->rebuildMapping();
+}
+
+QString Categorizer::otherCategoryLabel() const
+{
+    Q_D(const Categorizer);
+    return d->m_otherLabel;
+}
+
+void Categorizer::setOtherCategoryLabel(const QString& label)
+{
+    Q_D(Categorizer);
+    if (d->m_otherLabel == label)
+        return;
+    d->m_otherLabel = label;
+    otherCategoryLabelChanged(label);
+    if (d->otherShown()) {
+        const QModelIndex otherIdx = index(d->m_treeStructure.size() - 1, 0);
+        dataChanged(otherIdx, otherIdx);
+    }
+}
+
+bool Categorizer::isOtherCategory(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return false;
+    Q_ASSERT(index.model() == this);
+    Q_D(const Categorizer);
+    return d->m_otherCategory && d->itemForIndex(index) == d->m_otherCategory;
+}
+
+QVariantList Categorizer::rowCategoryKeys(const QVariant& key) const
+{
+    Q_D(const Categorizer);
+    if (!d->m_multiValuedKeys)
+        return QVariantList() << key;
+    return d->splitKey(key);
+}
+
+bool Categorizer::sameCategory(const QVariant& left, const QVariant& right) const
+{
+    Q_D(const Categorizer);
+    return d->sameCategoryKey(left, right);
+}
+
+bool Categorizer::lazyPopulation() const
+{
+    Q_D(const Categorizer);
+    return d->m_lazyPopulation;
+}
+
+void Categorizer::setLazyPopulation(bool lazy)
+{
+    Q_D(Categorizer);
+    if (d->m_lazyPopulation == lazy)
+        return;
+    d->m_lazyPopulation = lazy;
+    lazyPopulationChanged(lazy);
+    d->rebuildMapping();
+}
+
+int Categorizer::fetchBatchSize() const
+{
+    Q_D(const Categorizer);
+    return d->m_fetchBatchSize;
+}
+
+void Categorizer::setFetchBatchSize(int size)
+{
+    Q_D(Categorizer);
+    size = qMax(0, size);
+    if (d->m_fetchBatchSize == size)
+        return;
+    d->m_fetchBatchSize = size;
+    fetchBatchSizeChanged(size);
+}
+
+bool Categorizer::multiValuedKeys() const
+{
+    Q_D(const Categorizer);
+    return d->m_multiValuedKeys;
+}
+
+void Categorizer::setMultiValuedKeys(bool multiValued)
+{
+    Q_D(Categorizer);
+    if (d->m_multiValuedKeys == multiValued)
+        return;
+    d->m_multiValuedKeys = multiValued;
+    multiValuedKeysChanged(multiValued);
+    d->rebuildMapping();
+}
+
+QModelIndex Categorizer::sourceRoot() const
+{
+    Q_D(const Categorizer);
+    return d->m_sourceRoot;
+}
+
+void Categorizer::setSourceRoot(const QModelIndex& root)
+{
+    Q_D(Categorizer);
+    Q_ASSERT(!root.isValid() || root.model() == sourceModel());
+    if (root.isValid() && root.model() != sourceModel())
+        return;
+    if (d->m_sourceRoot == root)
+        return;
+    d->m_sourceRoot = root;
+    sourceRootChanged(root);
+    d->rebuildMapping();
+}
+
+int Categorizer::sourceDepth() const
+{
+    Q_D(const Categorizer);
+    return d->m_sourceDepth;
+}
+
+void Categorizer::setSourceDepth(int depth)
+{
+    Q_D(Categorizer);
+    depth = qMax(0, depth);
+    if (d->m_sourceDepth == depth)
+        return;
+    d->m_sourceDepth = depth;
+    sourceDepthChanged(depth);
+    d->rebuildMapping();
+}
+
+bool Categorizer::saveStructure(QIODevice* device, quint64 sourceVersion) const
+{
+    if (!sourceModel() || !device || !device->isWritable())
+        return false;
+    Q_D(const Categorizer);
+    return d->writeStructure(device, sourceVersion);
+}
+
+bool Categorizer::restoreStructure(QIODevice* device, quint64 sourceVersion)
+{
+    Q_D(Categorizer);
+    StoredStructure* const stored = new StoredStructure;
+    if (!d->readStructure(device, sourceVersion, *stored)) {
+        delete stored;
+        return false;
+    }
+    delete d->m_storedStructure;
+    d->m_storedStructure = stored;
+    // without a source the structure is used by setSourceModel
+    if (!sourceModel())
+        return true;
+    if (!d->canRestore(*stored)) {
+        delete d->m_storedStructure;
+        d->m_storedStructure = Q_NULLPTR;
+        return false;
+    }
+    d->rebuildMapping();
+    return true;
+}
+
+CategorizerSnapshot Categorizer::snapshot() const
+{
+    Q_D(const Categorizer);
+    if (!d->m_snapshotValid)
+        d->buildSnapshot();
+    return d->m_snapshot;
+}
+
+int Categorizer::categorySize(const QModelIndex &index) const
+{
+    if (!index.isValid() || !sourceModel())
+        return 0;
+    Q_ASSERT(index.model() == this);
+    Q_D(const Categorizer);
+    const TreeRow* const item = d->itemForIndex(index);
+    if (!d->isCategory(item))
+        return 0;
+    return d->categorySize(item);
+}
+
+bool Categorizer::canFetchMore(const QModelIndex &parent) const
+{
+    if (!sourceModel())
+        return false;
+    Q_D(const Categorizer);
+    if (!parent.isValid())
+        return !d->m_pendingCategories.isEmpty() || sourceModel()->canFetchMore(d->fetchableParent());
+    Q_ASSERT(parent.model() == this);
+    const TreeRow* const parentItem = d->itemForIndex(parent);
+    if (!parentItem || parentItem == d->m_otherCategory)
+        return false;
+    if (parentItem->columns().isEmpty()) {
+        if (!parentItem->pendingRows().isEmpty())
+            return true;
+        // rows not fetched by the source yet may belong to any category
+        if (d->pushdownEnabled() && parentItem->children().size() >= d->categorySize(parentItem))
+            return false;
+        return sourceModel()->canFetchMore(d->fetchableParent());
+    }
+    if (d->m_primaryLeaf.contains(parentItem))
+        return false;
+    return sourceModel()->canFetchMore(mapToSource(parent));
+}
+
+void Categorizer::fetchMore(const QModelIndex &parent)
+{
+    if (!sourceModel())
+        return;
+    Q_D(Categorizer);
+    if (!parent.isValid()) {
+        if (d->m_pendingCategories.isEmpty())
+            sourceModel()->fetchMore(d->fetchableParent());
+        else
+            d->fetchCategories(d->m_fetchBatchSize);
+        return;
+    }
+    Q_ASSERT(parent.model() == this);
+    TreeRow* const parentItem = d->itemForIndex(parent);
+    if (!parentItem || parentItem == d->m_otherCategory)
+        return;
+    if (parentItem->columns().isEmpty()) {
+        if (!parentItem->pendingRows().isEmpty())
+            d->fetchLeaves(parentItem, d->m_fetchBatchSize);
+        else if (d->pushdownEnabled())
+            d->fetchSourceRows(parentItem);
+        else
+            sourceModel()->fetchMore(d->fetchableParent());
+        return;
+    }
+    sourceModel()->fetchMore(mapToSource(parent));
+}
+
 QVariant Categorizer::dataForRoot(const QModelIndex &index, int role) const
 {
     Q_ASSERT(index.isValid());
-    Q_ASSERT(!index.parent().isValid());
     Q_ASSERT(index.model() == this);
     if (index.column() == 0 && (role == Qt::DisplayRole || role == CategorizerPrivate::RootDataRole)) {
         Q_D(const Categorizer);
-        return d->m_treeStructure.at(index.row())->category();
+        const TreeRow* const item = d->itemForIndex(index);
+        Q_ASSERT(item && item->columns().isEmpty());
+        if (item == d->m_otherCategory)
+            return d->m_otherLabel;
+        return d->categoryKey(item);
     }
     return QVariant();
 }
 
 bool Categorizer::sameKey(const QVariant& left, const QVariant& right) const
 {
+    Q_D(const Categorizer);
+    if (d->m_probingKeyFunctions)
+        ++d->m_defaultSameKeyReached;
     return left == right;
 }
 
+uint Categorizer::keyHash(const QVariant& key) const
+{
+    Q_D(const Categorizer);
+    if (d->m_probingKeyFunctions)
+        ++d->m_defaultKeyHashReached;
+    // numbers and strings holding the same text compare equal so they hash their text
+    if (key.canConvert<QString>())
+        return qHash(key.toString());
+    // other types hash their streamed value, equal values stream the same bytes
+    if (key.isValid()) {
+        QByteArray streamed;
+        QDataStream stream(&streamed, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_5_6);
+        if (QMetaType::save(stream, key.userType(), key.constData()))
+            return qHash(streamed) ^ qHash(key.userType());
+    }
+    return qHash(key.userType());
+}
+
+bool Categorizer::categoryCounts(QVariantList& keys, QVector<int>& counts) const
+{
+    Q_UNUSED(keys)
+    Q_UNUSED(counts)
+    return false;
+}
+
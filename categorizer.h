@@ -23,15 +23,39 @@ along with this program.  If not, see https://www.gnu.org/licenses/lgpl-3.0.html
 
 #include <QAbstractProxyModel>
 #include <QVariant>
+#include <QStringList>
+#include <QLocale>
+#include <QVector>
+#include "categorizersnapshot.h"
 class CategorizerPrivate;
+class QIODevice;
 class Categorizer : public  QAbstractProxyModel
 {
     Q_OBJECT
     Q_PROPERTY(int keyColumn READ keyColumn WRITE setKeyColumn NOTIFY keyColumnChanged)
     Q_PROPERTY(int keyRole READ keyRole WRITE setKeyRole NOTIFY keyRoleChanged)
+    Q_PROPERTY(KeyNormalization keyNormalization READ keyNormalization WRITE setKeyNormalization NOTIFY keyNormalizationChanged)
+    Q_PROPERTY(QLocale collationLocale READ collationLocale WRITE setCollationLocale NOTIFY collationLocaleChanged)
+    Q_PROPERTY(int topCategories READ topCategories WRITE setTopCategories NOTIFY topCategoriesChanged)
+    Q_PROPERTY(int categoryThreshold READ categoryThreshold WRITE setCategoryThreshold NOTIFY categoryThresholdChanged)
+    Q_PROPERTY(QString otherCategoryLabel READ otherCategoryLabel WRITE setOtherCategoryLabel NOTIFY otherCategoryLabelChanged)
+    Q_PROPERTY(bool lazyPopulation READ lazyPopulation WRITE setLazyPopulation NOTIFY lazyPopulationChanged)
+    Q_PROPERTY(int fetchBatchSize READ fetchBatchSize WRITE setFetchBatchSize NOTIFY fetchBatchSizeChanged)
+    Q_PROPERTY(bool multiValuedKeys READ multiValuedKeys WRITE setMultiValuedKeys NOTIFY multiValuedKeysChanged)
+    Q_PROPERTY(QModelIndex sourceRoot READ sourceRoot WRITE setSourceRoot NOTIFY sourceRootChanged)
+    Q_PROPERTY(int sourceDepth READ sourceDepth WRITE setSourceDepth NOTIFY sourceDepthChanged)
     Q_DISABLE_COPY(Categorizer)
     Q_DECLARE_PRIVATE_D(m_dptr, Categorizer)
 public:
+    enum KeyNormalizationFlag{
+        NoNormalization = 0x0
+        , CaseFolding = 0x1
+        , TrimWhitespace = 0x2
+        , UnicodeNormalization = 0x4
+        , LocaleCollation = 0x8
+    };
+    Q_DECLARE_FLAGS(KeyNormalization, KeyNormalizationFlag)
+    Q_FLAG(KeyNormalization)
     Categorizer(QObject* parent = Q_NULLPTR);
     ~Categorizer();
     void setSourceModel(QAbstractItemModel* newSourceModel) Q_DECL_OVERRIDE;
@@ -55,16 +79,68 @@ public:
     bool insertColumns(int column, int count, const QModelIndex &parent = QModelIndex()) Q_DECL_OVERRIDE;
     bool removeColumns(int column, int count, const QModelIndex &parent = QModelIndex()) Q_DECL_OVERRIDE;
     bool moveColumns(const QModelIndex &sourceParent, int sourceColumn, int count, const QModelIndex &destinationParent, int destinationChild) Q_DECL_OVERRIDE;
+    bool canFetchMore(const QModelIndex &parent) const Q_DECL_OVERRIDE;
+    void fetchMore(const QModelIndex &parent) Q_DECL_OVERRIDE;
+    Qt::DropActions supportedDragActions() const Q_DECL_OVERRIDE;
+    Qt::DropActions supportedDropActions() const Q_DECL_OVERRIDE;
+    QStringList mimeTypes() const Q_DECL_OVERRIDE;
+    QMimeData* mimeData(const QModelIndexList &indexes) const Q_DECL_OVERRIDE;
+    bool canDropMimeData(const QMimeData *data, Qt::DropAction action, int row, int column, const QModelIndex &parent) const Q_DECL_OVERRIDE;
+    bool dropMimeData(const QMimeData *data, Qt::DropAction action, int row, int column, const QModelIndex &parent) Q_DECL_OVERRIDE;
     int keyColumn() const;
     void setKeyColumn(int col);
     Q_SIGNAL void keyColumnChanged(int col);
     int keyRole() const;
     void setKeyRole(int role);
     Q_SIGNAL void keyRoleChanged(int role);
+    KeyNormalization keyNormalization() const;
+    void setKeyNormalization(KeyNormalization normalization);
+    Q_SIGNAL void keyNormalizationChanged(KeyNormalization normalization);
+    QLocale collationLocale() const;
+    void setCollationLocale(const QLocale& locale);
+    Q_SIGNAL void collationLocaleChanged(const QLocale& locale);
+    int topCategories() const;
+    void setTopCategories(int count);
+    Q_SIGNAL void topCategoriesChanged(int count);
+    int categoryThreshold() const;
+    void setCategoryThreshold(int count);
+    Q_SIGNAL void categoryThresholdChanged(int count);
+    QString otherCategoryLabel() const;
+    void setOtherCategoryLabel(const QString& label);
+    Q_SIGNAL void otherCategoryLabelChanged(const QString& label);
+    bool isOtherCategory(const QModelIndex &index) const;
+    // the keys of the categories a row with the given key is filed under and whether two keys share a category
+    QVariantList rowCategoryKeys(const QVariant& key) const;
+    bool sameCategory(const QVariant& left, const QVariant& right) const;
+    bool lazyPopulation() const;
+    void setLazyPopulation(bool lazy);
+    Q_SIGNAL void lazyPopulationChanged(bool lazy);
+    int fetchBatchSize() const;
+    void setFetchBatchSize(int size);
+    Q_SIGNAL void fetchBatchSizeChanged(int size);
+    bool multiValuedKeys() const;
+    void setMultiValuedKeys(bool multiValued);
+    Q_SIGNAL void multiValuedKeysChanged(bool multiValued);
+    QModelIndex sourceRoot() const;
+    void setSourceRoot(const QModelIndex& root);
+    Q_SIGNAL void sourceRootChanged(const QModelIndex& root);
+    // the rows that many levels below the source root are categorized, found through the first column of each level
+    int sourceDepth() const;
+    void setSourceDepth(int depth);
+    Q_SIGNAL void sourceDepthChanged(int depth);
+    bool saveStructure(QIODevice* device, quint64 sourceVersion) const;
+    bool restoreStructure(QIODevice* device, quint64 sourceVersion);
+    CategorizerSnapshot snapshot() const;
+    int categorySize(const QModelIndex &index) const;
     virtual QVariant dataForRoot(const QModelIndex &index, int role) const;
+    // keys that are the same for sameKey() must have the same keyHash(). If only sameKey() is reimplemented
+    // every lookup that misses its hash bucket compares against all the categories, reimplement both to keep lookups constant time
     virtual bool sameKey(const QVariant& left, const QVariant& right) const;
+    virtual uint keyHash(const QVariant& key) const;
+    virtual bool categoryCounts(QVariantList& keys, QVector<int>& counts) const;
 private:
     CategorizerPrivate* m_dptr;
 };
+Q_DECLARE_OPERATORS_FOR_FLAGS(Categorizer::KeyNormalization)
 
 #endif // TREEFYER_H
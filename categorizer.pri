@@ -0,0 +1,10 @@
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+HEADERS += \
+    $$PWD/categorizer.h \
+    $$PWD/categorizersnapshot.h
+
+SOURCES += \
+    $$PWD/categorizer.cpp \
+    $$PWD/categorizersnapshot.cpp
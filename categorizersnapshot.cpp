@@ -0,0 +1,73 @@
+#include "categorizersnapshot.h"
+
+class CategorizerSnapshotData : public QSharedData
+{
+public:
+    QVariantList keys;
+    QVector<int> offsets;
+    QVector<QVector<int> > sourceRows;
+};
+
+CategorizerSnapshot::CategorizerSnapshot()
+    : m_data(new CategorizerSnapshotData)
+{
+    m_data->offsets.append(0);
+}
+
+CategorizerSnapshot::CategorizerSnapshot(const QVariantList& keys, const QVector<int>& offsets, const QVector<QVector<int> >& sourceRows)
+    : m_data(new CategorizerSnapshotData)
+{
+    Q_ASSERT(offsets.size() == keys.size() + 1);
+    Q_ASSERT(sourceRows.size() == keys.size());
+    m_data->keys = keys;
+    m_data->offsets = offsets;
+    m_data->sourceRows = sourceRows;
+}
+
+CategorizerSnapshot::CategorizerSnapshot(const CategorizerSnapshot& other) = default;
+CategorizerSnapshot& CategorizerSnapshot::operator=(const CategorizerSnapshot& other) = default;
+CategorizerSnapshot::~CategorizerSnapshot() = default;
+
+bool CategorizerSnapshot::isEmpty() const
+{
+    return m_data->keys.isEmpty();
+}
+
+int CategorizerSnapshot::categoryCount() const
+{
+    return m_data->keys.size();
+}
+
+QVariant CategorizerSnapshot::categoryKey(int category) const
+{
+    return m_data->keys.value(category);
+}
+
+int CategorizerSnapshot::categorySize(int category) const
+{
+    if (category < 0 || category >= m_data->keys.size())
+        return 0;
+    return m_data->offsets.at(category + 1) - m_data->offsets.at(category);
+}
+
+const int* CategorizerSnapshot::categoryRows(int category) const
+{
+    if (category < 0 || category >= m_data->keys.size())
+        return Q_NULLPTR;
+    return m_data->sourceRows.at(category).constData();
+}
+
+const QVariantList& CategorizerSnapshot::categoryKeys() const
+{
+    return m_data->keys;
+}
+
+const QVector<int>& CategorizerSnapshot::offsets() const
+{
+    return m_data->offsets;
+}
+
+QVector<int> CategorizerSnapshot::sourceRows(int category) const
+{
+    return m_data->sourceRows.value(category);
+}
@@ -0,0 +1,52 @@
+/****************************************************************************\
+
+InsertProxy
+Copyright (C) 2017 Luca Beldi.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/lgpl-3.0.html.
+
+\****************************************************************************/
+#ifndef CATEGORIZERSNAPSHOT_H
+#define CATEGORIZERSNAPSHOT_H
+
+#include <QSharedDataPointer>
+#include <QVariant>
+#include <QVector>
+class CategorizerSnapshotData;
+
+// Immutable copy of the categories of a Categorizer and the source rows in each of them.
+// Copies share the same arrays and can be read from any thread, the rows of a category are shared
+// with the following snapshots until the category changes
+class CategorizerSnapshot
+{
+public:
+    CategorizerSnapshot();
+    CategorizerSnapshot(const CategorizerSnapshot& other);
+    CategorizerSnapshot& operator=(const CategorizerSnapshot& other);
+    ~CategorizerSnapshot();
+    bool isEmpty() const;
+    int categoryCount() const;
+    QVariant categoryKey(int category) const;
+    int categorySize(int category) const;
+    const int* categoryRows(int category) const;
+    const QVariantList& categoryKeys() const;
+    const QVector<int>& offsets() const;
+    QVector<int> sourceRows(int category) const;
+private:
+    CategorizerSnapshot(const QVariantList& keys, const QVector<int>& offsets, const QVector<QVector<int> >& sourceRows);
+    QSharedDataPointer<CategorizerSnapshotData> m_data;
+    friend class CategorizerPrivate;
+};
+
+#endif // CATEGORIZERSNAPSHOT_H
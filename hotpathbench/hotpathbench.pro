@@ -0,0 +1,13 @@
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+TARGET = hotpathbench
+
+include(../categorizer.pri)
+
+HEADERS += \
+    ../tracereplay/syntheticmodel.h
+
+SOURCES += \
+    ../tracereplay/syntheticmodel.cpp \
+    main.cpp
@@ -0,0 +1,193 @@
+#include "../categorizer.h"
+#include "../tracereplay/syntheticmodel.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <cstdlib>
+#include <new>
+
+namespace {
+bool countAllocations = false;
+quint64 allocationCount = 0;
+}
+
+void* operator new(std::size_t size)
+{
+    if (countAllocations)
+        ++allocationCount;
+    void* const result = std::malloc(size > 0 ? size : 1);
+    if (!result)
+        throw std::bad_alloc();
+    return result;
+}
+
+void operator delete(void* ptr) Q_DECL_NOTHROW
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) Q_DECL_NOTHROW
+{
+    ::operator delete(ptr);
+}
+
+namespace {
+enum HotPathCall { IndexCall, DataCall, FlagsCall, ParentCall, HotPathCallCount };
+
+QString callName(int call)
+{
+    switch (call) {
+    case IndexCall: return QStringLiteral("index()");
+    case DataCall: return QStringLiteral("data()");
+    case FlagsCall: return QStringLiteral("flags()");
+    case ParentCall: return QStringLiteral("parent()");
+    default: return QString();
+    }
+}
+
+struct HotPathCost{
+    HotPathCost()
+        : calls(0)
+        , allocations(0)
+    {
+        for (int i = 0; i < HotPathCallCount; ++i)
+            nanoseconds[i] = 0;
+    }
+    qint64 nanoseconds[HotPathCallCount];
+    int calls;
+    quint64 allocations;
+};
+
+volatile int sink = 0;
+
+// resolves and paints a window of cells in the middle of every category, like a view repainting
+HotPathCost measure(int rowCount, int categoryCount, int columnCount, int window, int passes)
+{
+    SyntheticModel source(0, Qt::DisplayRole);
+    QVariantList keys;
+    keys.reserve(rowCount);
+    for (int i = 0; i < rowCount; ++i)
+        keys.append(i % categoryCount);
+    source.resetContent(columnCount, keys);
+    Categorizer proxy;
+    proxy.setSourceModel(&source);
+
+    QVector<QModelIndex> parents;
+    QVector<int> firstRows;
+    int cellCount = 0;
+    const int catCnt = proxy.rowCount();
+    for (int i = 0; i < catCnt; ++i) {
+        const QModelIndex catIdx = proxy.index(i, 0);
+        parents.append(catIdx);
+        firstRows.append(qMax(0, (proxy.rowCount(catIdx) - window) / 2));
+        cellCount += qMin(window, proxy.rowCount(catIdx)) * columnCount;
+    }
+    // filled in place so the timed loops never allocate on their own
+    QVector<QModelIndex> cells(cellCount);
+
+    HotPathCost result;
+    QElapsedTimer clock;
+    for (int pass = -1; pass < passes; ++pass) {
+        // the first pass only warms up the caches
+        const bool timed = pass >= 0;
+        QModelIndex* cell = cells.data();
+        countAllocations = timed;
+        clock.start();
+        for (int i = 0; i < catCnt; ++i) {
+            const int lastRow = qMin(firstRows.at(i) + window, proxy.rowCount(parents.at(i)));
+            for (int row = firstRows.at(i); row < lastRow; ++row) {
+                for (int col = 0; col < columnCount; ++col)
+                    *(cell++) = proxy.index(row, col, parents.at(i));
+            }
+        }
+        const qint64 indexTime = clock.nsecsElapsed();
+        clock.start();
+        for (auto i = cells.cbegin(); i != cells.cend(); ++i)
+            sink += proxy.data(*i).userType();
+        const qint64 dataTime = clock.nsecsElapsed();
+        clock.start();
+        for (auto i = cells.cbegin(); i != cells.cend(); ++i)
+            sink += proxy.flags(*i);
+        const qint64 flagsTime = clock.nsecsElapsed();
+        clock.start();
+        for (auto i = cells.cbegin(); i != cells.cend(); ++i)
+            sink += proxy.parent(*i).row();
+        const qint64 parentTime = clock.nsecsElapsed();
+        countAllocations = false;
+        if (!timed) {
+            allocationCount = 0;
+            continue;
+        }
+        result.nanoseconds[IndexCall] += indexTime;
+        result.nanoseconds[DataCall] += dataTime;
+        result.nanoseconds[FlagsCall] += flagsTime;
+        result.nanoseconds[ParentCall] += parentTime;
+        result.calls += cells.size();
+    }
+    result.allocations = allocationCount;
+    allocationCount = 0;
+    return result;
+}
+
+double nanosecondsPerCall(const HotPathCost& cost, int call)
+{
+    return cost.calls > 0 ? double(cost.nanoseconds[call]) / cost.calls : 0.0;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("hotpathbench"));
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Checks that index(), data(), flags() and parent() of a Categorizer cost the same at any size and never allocate"));
+    parser.addHelpOption();
+    const QCommandLineOption rowsOption(QStringLiteral("rows"), QStringLiteral("Source rows of the largest model"), QStringLiteral("n"), QStringLiteral("1000000"));
+    const QCommandLineOption categoriesOption(QStringLiteral("categories"), QStringLiteral("Categories of the largest model"), QStringLiteral("n"), QStringLiteral("10000"));
+    const QCommandLineOption columnsOption(QStringLiteral("columns"), QStringLiteral("Source columns"), QStringLiteral("n"), QStringLiteral("4"));
+    const QCommandLineOption windowOption(QStringLiteral("window"), QStringLiteral("Rows painted in every category"), QStringLiteral("n"), QStringLiteral("50"));
+    const QCommandLineOption passesOption(QStringLiteral("passes"), QStringLiteral("Timed passes for every size"), QStringLiteral("n"), QStringLiteral("5"));
+    const QCommandLineOption growthOption(QStringLiteral("max-growth"), QStringLiteral("Largest accepted ratio between the cost per call of the largest and the smallest model"), QStringLiteral("ratio"), QStringLiteral("3"));
+    parser.addOption(rowsOption);
+    parser.addOption(categoriesOption);
+    parser.addOption(columnsOption);
+    parser.addOption(windowOption);
+    parser.addOption(passesOption);
+    parser.addOption(growthOption);
+    parser.process(app);
+    QTextStream out(stdout);
+    const int rows = qMax(100, parser.value(rowsOption).toInt());
+    const int categories = qMax(1, parser.value(categoriesOption).toInt());
+    const int columns = qMax(1, parser.value(columnsOption).toInt());
+    const int window = qMax(1, parser.value(windowOption).toInt());
+    const int passes = qMax(1, parser.value(passesOption).toInt());
+    const double maxGrowth = parser.value(growthOption).toDouble();
+
+    // rows and categories grow together so both levels of siblings get longer
+    QVector<HotPathCost> costs;
+    for (int scale = 100; scale >= 1; scale /= 10) {
+        const int scaledRows = rows / scale;
+        const int scaledCategories = qMax(1, categories / scale);
+        const HotPathCost cost = measure(scaledRows, scaledCategories, columns, window, passes);
+        costs.append(cost);
+        out << scaledRows << " rows, " << scaledCategories << " categories: " << cost.calls << " calls";
+        for (int call = 0; call < HotPathCallCount; ++call)
+            out << ", " << callName(call) << ' ' << QString::number(nanosecondsPerCall(cost, call), 'f', 1) << "ns";
+        out << ", " << cost.allocations << " allocations" << Qt::endl;
+    }
+    int failures = 0;
+    for (int call = 0; call < HotPathCallCount; ++call) {
+        const double smallest = nanosecondsPerCall(costs.first(), call);
+        const double growth = smallest > 0.0 ? nanosecondsPerCall(costs.last(), call) / smallest : 0.0;
+        out << callName(call) << " growth: " << QString::number(growth, 'f', 2) << Qt::endl;
+        if (maxGrowth > 0.0 && growth > maxGrowth)
+            ++failures;
+    }
+    for (auto i = costs.cbegin(); i != costs.cend(); ++i) {
+        if (i->allocations > 0)
+            ++failures;
+    }
+    out << "Failures: " << failures << Qt::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,366 @@
+#include "sourcetrace.h"
+#include "categorizer.h"
+#include <QAbstractItemModel>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QList>
+#include <functional>
+
+class SourceTraceRecorderPrivate{
+    Q_DISABLE_COPY(SourceTraceRecorderPrivate)
+    Q_DECLARE_PUBLIC(SourceTraceRecorder);
+    SourceTraceRecorderPrivate(SourceTraceRecorder* q);
+    QList<QMetaObject::Connection> m_modelConnections;
+    QAbstractItemModel* m_model;
+    QDataStream m_stream;
+    QElapsedTimer m_clock;
+    int m_keyColumn;
+    int m_keyRole;
+    int m_eventCount;
+    SourceTraceRecorder* q_ptr;
+    QVector<int> pathForIndex(QModelIndex idx) const;
+    bool startRecording(QAbstractItemModel* model, QIODevice* device, const SourceTrace& header);
+    QVariantList keysForRows(const QModelIndex& parent, int first, int last) const;
+    void recordSubtree(const QModelIndex& parent, SourceTraceEvent& event) const;
+    void writeEvent(const SourceTraceEvent& event);
+    void onModelReset();
+    void onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles);
+    void onRowsInserted(const QModelIndex &parent, int first, int last);
+    void onRowsRemoved(const QModelIndex &parent, int first, int last);
+    void onColumnsInserted(const QModelIndex &parent, int first, int last);
+    enum : quint32 { TraceMagic = 0x43545243 };
+    enum : quint16 { TraceVersion = 4 };
+};
+
+SourceTraceEvent::SourceTraceEvent()
+    : type(ModelReset)
+    , timestamp(0)
+    , first(-1)
+    , last(-1)
+    , firstColumn(-1)
+    , lastColumn(-1)
+    , columnCount(0)
+{}
+
+SourceTrace::SourceTrace()
+    : keyColumn(0)
+    , keyRole(Qt::DisplayRole)
+    , keyNormalization(Categorizer::NoNormalization)
+    , multiValuedKeys(false)
+    , lazyPopulation(false)
+    , fetchBatchSize(256)
+    , topCategories(0)
+    , categoryThreshold(0)
+    , sourceDepth(0)
+{}
+
+SourceTraceRecorderPrivate::SourceTraceRecorderPrivate(SourceTraceRecorder* q)
+    : m_model(Q_NULLPTR)
+    , m_keyColumn(0)
+    , m_keyRole(Qt::DisplayRole)
+    , m_eventCount(0)
+    , q_ptr(q)
+{
+    Q_ASSERT(q_ptr);
+    m_stream.setVersion(QDataStream::Qt_5_6);
+}
+
+QVector<int> SourceTraceRecorderPrivate::pathForIndex(QModelIndex idx) const
+{
+    QVector<int> result;
+    for (; idx.isValid(); idx = idx.parent())
+        result.prepend(idx.row());
+    return result;
+}
+
+bool SourceTraceRecorderPrivate::startRecording(QAbstractItemModel* model, QIODevice* device, const SourceTrace& header)
+{
+    Q_Q(SourceTraceRecorder);
+    if (!model || !device || !device->isWritable())
+        return false;
+    q->stop();
+    m_model = model;
+    m_keyColumn = header.keyColumn;
+    m_keyRole = header.keyRole;
+    m_eventCount = 0;
+    m_stream.setDevice(device);
+    m_stream << quint32(TraceMagic) << quint16(TraceVersion) << qint32(header.keyColumn) << qint32(header.keyRole) << header.rootPath
+        << qint32(header.keyNormalization) << header.collationLocale << header.multiValuedKeys << header.lazyPopulation
+        << qint32(header.fetchBatchSize) << qint32(header.topCategories) << qint32(header.categoryThreshold) << qint32(header.sourceDepth);
+    m_clock.start();
+    // the initial content is recorded as a reset so the replay starts from the same state
+    onModelReset();
+    m_modelConnections
+        << QObject::connect(model, &QAbstractItemModel::modelReset, q, std::bind(&SourceTraceRecorderPrivate::onModelReset, this))
+        << QObject::connect(model, &QAbstractItemModel::dataChanged, q, std::bind(&SourceTraceRecorderPrivate::onDataChanged, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3))
+        << QObject::connect(model, &QAbstractItemModel::rowsInserted, q, std::bind(&SourceTraceRecorderPrivate::onRowsInserted, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3))
+        << QObject::connect(model, &QAbstractItemModel::rowsRemoved, q, std::bind(&SourceTraceRecorderPrivate::onRowsRemoved, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3))
+        << QObject::connect(model, &QAbstractItemModel::columnsInserted, q, std::bind(&SourceTraceRecorderPrivate::onColumnsInserted, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3))
+        << QObject::connect(model, &QObject::destroyed, q, &SourceTraceRecorder::stop)
+        ;
+    return m_stream.status() == QDataStream::Ok;
+}
+
+QVariantList SourceTraceRecorderPrivate::keysForRows(const QModelIndex& parent, int first, int last) const
+{
+    QVariantList result;
+    if (m_keyColumn >= m_model->columnCount(parent))
+        return result;
+    result.reserve(last - first + 1);
+    for (int i = first; i <= last; ++i)
+        result.append(m_model->index(i, m_keyColumn, parent).data(m_keyRole));
+    return result;
+}
+
+void SourceTraceRecorderPrivate::recordSubtree(const QModelIndex& parent, SourceTraceEvent& event) const
+{
+    const int rowCnt = m_model->rowCount(parent);
+    const bool hasKeys = m_keyColumn < m_model->columnCount(parent);
+    for (int i = 0; i < rowCnt; ++i) {
+        const QModelIndex rowIdx = m_model->index(i, 0, parent);
+        event.keys.append(hasKeys ? m_model->index(i, m_keyColumn, parent).data(m_keyRole) : QVariant());
+        event.rowCounts.append(m_model->rowCount(rowIdx));
+        event.columnCounts.append(m_model->columnCount(rowIdx));
+        recordSubtree(rowIdx, event);
+    }
+}
+
+void SourceTraceRecorderPrivate::writeEvent(const SourceTraceEvent& event)
+{
+    m_stream << static_cast<quint8>(event.type) << event.timestamp;
+    switch (event.type) {
+    case SourceTraceEvent::ModelReset:
+        m_stream << qint32(event.columnCount) << event.keys << event.rowCounts << event.columnCounts;
+        break;
+    case SourceTraceEvent::DataChanged:
+        m_stream << event.parentPath << qint32(event.first) << qint32(event.last) << qint32(event.firstColumn) << qint32(event.lastColumn) << event.roles << event.keys;
+        break;
+    case SourceTraceEvent::RowsInserted:
+        m_stream << event.parentPath << qint32(event.first) << qint32(event.last) << event.keys;
+        break;
+    case SourceTraceEvent::RowsRemoved:
+    case SourceTraceEvent::ColumnsInserted:
+        m_stream << event.parentPath << qint32(event.first) << qint32(event.last);
+        break;
+    default:
+        Q_UNREACHABLE();
+    }
+    ++m_eventCount;
+}
+
+void SourceTraceRecorderPrivate::onModelReset()
+{
+    SourceTraceEvent event;
+    event.type = SourceTraceEvent::ModelReset;
+    event.timestamp = m_clock.nsecsElapsed();
+    event.columnCount = m_model->columnCount();
+    // the rows below the top level are needed to replay changes under them
+    recordSubtree(QModelIndex(), event);
+    writeEvent(event);
+}
+
+void SourceTraceRecorderPrivate::onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles)
+{
+    if (!topLeft.isValid() || !bottomRight.isValid())
+        return;
+    SourceTraceEvent event;
+    event.type = SourceTraceEvent::DataChanged;
+    event.timestamp = m_clock.nsecsElapsed();
+    event.parentPath = pathForIndex(topLeft.parent());
+    event.first = topLeft.row();
+    event.last = bottomRight.row();
+    event.firstColumn = topLeft.column();
+    event.lastColumn = bottomRight.column();
+    event.roles = roles;
+    if ((roles.isEmpty() || roles.contains(m_keyRole)) && event.firstColumn <= m_keyColumn && event.lastColumn >= m_keyColumn)
+        event.keys = keysForRows(topLeft.parent(), event.first, event.last);
+    writeEvent(event);
+}
+
+void SourceTraceRecorderPrivate::onRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    SourceTraceEvent event;
+    event.type = SourceTraceEvent::RowsInserted;
+    event.timestamp = m_clock.nsecsElapsed();
+    event.parentPath = pathForIndex(parent);
+    event.first = first;
+    event.last = last;
+    event.keys = keysForRows(parent, first, last);
+    writeEvent(event);
+}
+
+void SourceTraceRecorderPrivate::onRowsRemoved(const QModelIndex &parent, int first, int last)
+{
+    SourceTraceEvent event;
+    event.type = SourceTraceEvent::RowsRemoved;
+    event.timestamp = m_clock.nsecsElapsed();
+    event.parentPath = pathForIndex(parent);
+    event.first = first;
+    event.last = last;
+    writeEvent(event);
+}
+
+void SourceTraceRecorderPrivate::onColumnsInserted(const QModelIndex &parent, int first, int last)
+{
+    SourceTraceEvent event;
+    event.type = SourceTraceEvent::ColumnsInserted;
+    event.timestamp = m_clock.nsecsElapsed();
+    event.parentPath = pathForIndex(parent);
+    event.first = first;
+    event.last = last;
+    writeEvent(event);
+}
+
+SourceTraceRecorder::SourceTraceRecorder(QObject* parent)
+    : QObject(parent)
+    , m_dptr(new SourceTraceRecorderPrivate(this))
+{}
+
+SourceTraceRecorder::~SourceTraceRecorder()
+{
+    stop();
+    delete m_dptr;
+}
+
+bool SourceTraceRecorder::start(QAbstractItemModel* model, QIODevice* device, int keyColumn, int keyRole, const QModelIndex& sourceRoot)
+{
+    if (sourceRoot.isValid() && sourceRoot.model() != model)
+        return false;
+    Q_D(SourceTraceRecorder);
+    SourceTrace header;
+    header.keyColumn = keyColumn;
+    header.keyRole = keyRole;
+    header.rootPath = d->pathForIndex(sourceRoot);
+    return d->startRecording(model, device, header);
+}
+
+bool SourceTraceRecorder::start(const Categorizer* categorizer, QIODevice* device)
+{
+    if (!categorizer)
+        return false;
+    Q_D(SourceTraceRecorder);
+    // the replay needs every setting that changes where rows are filed
+    SourceTrace header;
+    header.keyColumn = categorizer->keyColumn();
+    header.keyRole = categorizer->keyRole();
+    header.rootPath = d->pathForIndex(categorizer->sourceRoot());
+    header.keyNormalization = static_cast<int>(categorizer->keyNormalization());
+    header.collationLocale = categorizer->collationLocale().name();
+    header.multiValuedKeys = categorizer->multiValuedKeys();
+    header.lazyPopulation = categorizer->lazyPopulation();
+    header.fetchBatchSize = categorizer->fetchBatchSize();
+    header.topCategories = categorizer->topCategories();
+    header.categoryThreshold = categorizer->categoryThreshold();
+    header.sourceDepth = categorizer->sourceDepth();
+    return d->startRecording(categorizer->sourceModel(), device, header);
+}
+
+void SourceTraceRecorder::stop()
+{
+    Q_D(SourceTraceRecorder);
+    const auto connEnd = d->m_modelConnections.cend();
+    for (auto discIter = d->m_modelConnections.cbegin(); discIter != connEnd; ++discIter)
+        QObject::disconnect(*discIter);
+    d->m_modelConnections.clear();
+    d->m_model = Q_NULLPTR;
+    d->m_stream.setDevice(Q_NULLPTR);
+}
+
+bool SourceTraceRecorder::isRecording() const
+{
+    Q_D(const SourceTraceRecorder);
+    return d->m_model;
+}
+
+int SourceTraceRecorder::eventCount() const
+{
+    Q_D(const SourceTraceRecorder);
+    return d->m_eventCount;
+}
+
+bool SourceTraceRecorder::readTrace(QIODevice* device, SourceTrace& trace)
+{
+    if (!device || !device->isReadable())
+        return false;
+    QDataStream stream(device);
+    stream.setVersion(QDataStream::Qt_5_6);
+    quint32 magic = 0;
+    quint16 version = 0;
+    qint32 keyColumn = 0;
+    qint32 keyRole = 0;
+    stream >> magic >> version >> keyColumn >> keyRole;
+    if (stream.status() != QDataStream::Ok || magic != SourceTraceRecorderPrivate::TraceMagic || version < 1 || version > SourceTraceRecorderPrivate::TraceVersion)
+        return false;
+    // older versions always categorized the top level rows with the default settings
+    const SourceTrace defaults;
+    trace.rootPath.clear();
+    if (version >= 3)
+        stream >> trace.rootPath;
+    qint32 keyNormalization = defaults.keyNormalization;
+    qint32 fetchBatchSize = defaults.fetchBatchSize;
+    qint32 topCategories = defaults.topCategories;
+    qint32 categoryThreshold = defaults.categoryThreshold;
+    qint32 sourceDepth = defaults.sourceDepth;
+    trace.collationLocale = defaults.collationLocale;
+    trace.multiValuedKeys = defaults.multiValuedKeys;
+    trace.lazyPopulation = defaults.lazyPopulation;
+    if (version >= 4) {
+        stream >> keyNormalization >> trace.collationLocale >> trace.multiValuedKeys >> trace.lazyPopulation
+            >> fetchBatchSize >> topCategories >> categoryThreshold >> sourceDepth;
+    }
+    if (stream.status() != QDataStream::Ok)
+        return false;
+    trace.keyColumn = keyColumn;
+    trace.keyRole = keyRole;
+    trace.keyNormalization = keyNormalization;
+    trace.fetchBatchSize = fetchBatchSize;
+    trace.topCategories = topCategories;
+    trace.categoryThreshold = categoryThreshold;
+    trace.sourceDepth = sourceDepth;
+    trace.events.clear();
+    while (!stream.atEnd()) {
+        SourceTraceEvent event;
+        quint8 type = 0;
+        qint32 first = -1;
+        qint32 last = -1;
+        stream >> type >> event.timestamp;
+        if (type >= SourceTraceEvent::TypeCount)
+            return false;
+        event.type = static_cast<SourceTraceEvent::Type>(type);
+        switch (event.type) {
+        case SourceTraceEvent::ModelReset: {
+            qint32 columnCount = 0;
+            stream >> columnCount >> event.keys;
+            // the first version only recorded the top level rows
+            if (version >= 2) {
+                stream >> event.rowCounts >> event.columnCounts;
+                if (event.rowCounts.size() != event.keys.size() || event.columnCounts.size() != event.keys.size())
+                    return false;
+            }
+            event.columnCount = columnCount;
+            break;
+        }
+        case SourceTraceEvent::DataChanged: {
+            qint32 firstColumn = -1;
+            qint32 lastColumn = -1;
+            stream >> event.parentPath >> first >> last >> firstColumn >> lastColumn >> event.roles >> event.keys;
+            event.firstColumn = firstColumn;
+            event.lastColumn = lastColumn;
+            break;
+        }
+        case SourceTraceEvent::RowsInserted:
+            stream >> event.parentPath >> first >> last >> event.keys;
+            break;
+        default:
+            stream >> event.parentPath >> first >> last;
+            break;
+        }
+        if (stream.status() != QDataStream::Ok)
+            return false;
+        event.first = first;
+        event.last = last;
+        trace.events.append(event);
+    }
+    return true;
+}
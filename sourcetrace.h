@@ -0,0 +1,91 @@
+/****************************************************************************\
+
+InsertProxy
+Copyright (C) 2017 Luca Beldi.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/lgpl-3.0.html.
+
+\****************************************************************************/
+#ifndef SOURCETRACE_H
+#define SOURCETRACE_H
+
+#include <QModelIndex>
+#include <QObject>
+#include <QVariant>
+#include <QVector>
+class QAbstractItemModel;
+class QIODevice;
+class Categorizer;
+
+struct SourceTraceEvent{
+    enum Type : quint8 {
+        ModelReset = 0
+        , DataChanged
+        , RowsInserted
+        , RowsRemoved
+        , ColumnsInserted
+        , TypeCount
+    };
+    SourceTraceEvent();
+    Type type;
+    qint64 timestamp; // nanoseconds since the recording started
+    QVector<int> parentPath; // rows from the top of the source down to the parent
+    int first;
+    int last;
+    int firstColumn;
+    int lastColumn;
+    int columnCount;
+    QVector<int> roles;
+    QVariantList keys; // a reset lists every row of the tree depth first
+    QVector<int> rowCounts; // children of each row in keys, resets only
+    QVector<int> columnCounts; // columns of the children of each row in keys, resets only
+};
+
+struct SourceTrace{
+    SourceTrace();
+    int keyColumn;
+    int keyRole;
+    QVector<int> rootPath; // source root of the categorizer, empty for the top level rows
+    // configuration of the recorded categorizer, the defaults when recording a plain model
+    int keyNormalization;
+    QString collationLocale; // empty for the default locale
+    bool multiValuedKeys;
+    bool lazyPopulation;
+    int fetchBatchSize;
+    int topCategories;
+    int categoryThreshold;
+    int sourceDepth;
+    QVector<SourceTraceEvent> events;
+};
+
+class SourceTraceRecorderPrivate;
+class SourceTraceRecorder : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(SourceTraceRecorder)
+    Q_DECLARE_PRIVATE_D(m_dptr, SourceTraceRecorder)
+public:
+    SourceTraceRecorder(QObject* parent = Q_NULLPTR);
+    ~SourceTraceRecorder();
+    bool start(QAbstractItemModel* model, QIODevice* device, int keyColumn = 0, int keyRole = Qt::DisplayRole, const QModelIndex& sourceRoot = QModelIndex());
+    bool start(const Categorizer* categorizer, QIODevice* device);
+    void stop();
+    bool isRecording() const;
+    int eventCount() const;
+    static bool readTrace(QIODevice* device, SourceTrace& trace);
+private:
+    SourceTraceRecorderPrivate* m_dptr;
+};
+
+#endif // SOURCETRACE_H
@@ -0,0 +1,34 @@
+#include "sqlcategorizer.h"
+#include <QSqlDriver>
+#include <QSqlQuery>
+#include <QSqlQueryModel>
+#include <QSqlRecord>
+#include <QSqlResult>
+
+SqlCategorizer::SqlCategorizer(QObject* parent)
+    : Categorizer(parent)
+{}
+
+bool SqlCategorizer::categoryCounts(QVariantList& keys, QVector<int>& counts) const
+{
+    const QSqlQueryModel* const sqlModel = qobject_cast<const QSqlQueryModel*>(sourceModel());
+    if (!sqlModel || (keyRole() != Qt::DisplayRole && keyRole() != Qt::EditRole))
+        return false;
+    const QSqlQuery sourceQuery = sqlModel->query();
+    const QString sourceText = sourceQuery.lastQuery();
+    const QString keyField = sqlModel->record().fieldName(keyColumn());
+    // bound values can't be replayed reliably in the wrapping query
+    if (!sourceQuery.driver() || sourceText.isEmpty() || keyField.isEmpty() || !sourceQuery.boundValues().isEmpty())
+        return false;
+    const QString escapedField = sourceQuery.driver()->escapeIdentifier(keyField, QSqlDriver::FieldName);
+    // the result takes the same connection as the source, the query takes ownership of it
+    QSqlQuery countQuery(sourceQuery.driver()->createResult());
+    countQuery.setForwardOnly(true);
+    if (!countQuery.exec(QStringLiteral("SELECT %1, COUNT(*) FROM (%2) categorizer_source GROUP BY %1 ORDER BY %1").arg(escapedField, sourceText)))
+        return false;
+    while (countQuery.next()) {
+        keys.append(countQuery.value(0));
+        counts.append(countQuery.value(1).toInt());
+    }
+    return true;
+}
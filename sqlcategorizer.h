@@ -0,0 +1,36 @@
+/****************************************************************************\
+
+InsertProxy
+Copyright (C) 2017 Luca Beldi.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/lgpl-3.0.html.
+
+\****************************************************************************/
+#ifndef SQLCATEGORIZER_H
+#define SQLCATEGORIZER_H
+
+#include "categorizer.h"
+
+// Categorizer for QSqlQueryModel sources that counts the categories with a GROUP BY on the key column.
+// The source query must be sorted by the key column, leaves are then placed by position as the source fetches them
+class SqlCategorizer : public Categorizer
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(SqlCategorizer)
+public:
+    SqlCategorizer(QObject* parent = Q_NULLPTR);
+    bool categoryCounts(QVariantList& keys, QVector<int>& counts) const Q_DECL_OVERRIDE;
+};
+
+#endif // SQLCATEGORIZER_H
@@ -0,0 +1,9 @@
+include($$PWD/categorizer.pri)
+
+QT += sql
+
+HEADERS += \
+    $$PWD/sqlcategorizer.h
+
+SOURCES += \
+    $$PWD/sqlcategorizer.cpp
@@ -0,0 +1,8 @@
+QT += testlib gui
+CONFIG += testcase console
+CONFIG -= app_bundle
+TARGET = tst_categorizer
+
+include(../../categorizer.pri)
+
+SOURCES += tst_categorizer.cpp
@@ -0,0 +1,191 @@
+#include "categorizer.h"
+#include "categorizersnapshot.h"
+#include <QBuffer>
+#include <QSignalSpy>
+#include <QStandardItemModel>
+#include <QtTest>
+
+class tst_Categorizer : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void insertColumnsWithPendingCategories();
+    void restoreStructureKeepsOrder();
+    void categorizeRowsBelowDepth();
+    void snapshotSharesUnchangedCategories();
+    void dragOnlyEditableKeys();
+private:
+    void fillModel(QStandardItemModel& source, int rowCount);
+};
+
+void tst_Categorizer::fillModel(QStandardItemModel& source, int rowCount)
+{
+    source.setColumnCount(1);
+    for (int i = 0; i < rowCount; ++i)
+        source.appendRow(new QStandardItem(QString(QChar('a' + i))));
+}
+
+void tst_Categorizer::insertColumnsWithPendingCategories()
+{
+    QStandardItemModel source;
+    fillModel(source, 10);
+    Categorizer proxy;
+    proxy.setLazyPopulation(true);
+    proxy.setFetchBatchSize(2);
+    proxy.setSourceModel(&source);
+    QCOMPARE(proxy.rowCount(), 2);
+    QVERIFY(proxy.canFetchMore(QModelIndex()));
+    QSignalSpy insertSpy(&proxy, &QAbstractItemModel::columnsInserted);
+    QVERIFY(source.insertColumn(1));
+    // one signal for the root and one for each category already fetched
+    int rootInserts = 0;
+    for (auto i = insertSpy.cbegin(); i != insertSpy.cend(); ++i) {
+        if (!i->at(0).value<QModelIndex>().isValid())
+            ++rootInserts;
+    }
+    QCOMPARE(rootInserts, 1);
+    QCOMPARE(insertSpy.size(), 1 + proxy.rowCount());
+    QCOMPARE(proxy.columnCount(), 2);
+    while (proxy.canFetchMore(QModelIndex()))
+        proxy.fetchMore(QModelIndex());
+    QCOMPARE(proxy.rowCount(), 10);
+    for (int i = 0; i < proxy.rowCount(); ++i) {
+        const QModelIndex catIdx = proxy.index(i, 0);
+        while (proxy.canFetchMore(catIdx))
+            proxy.fetchMore(catIdx);
+        QCOMPARE(proxy.rowCount(catIdx), 1);
+        QCOMPARE(proxy.columnCount(catIdx), 2);
+        QCOMPARE(proxy.mapToSource(proxy.index(0, 1, catIdx)), source.index(i, 1));
+    }
+}
+
+void tst_Categorizer::restoreStructureKeepsOrder()
+{
+    QStandardItemModel source;
+    source.setColumnCount(1);
+    const QStringList keys{QStringLiteral("b"), QStringLiteral("a"), QStringLiteral("b"), QStringLiteral("c")};
+    for (auto i = keys.cbegin(); i != keys.cend(); ++i)
+        source.appendRow(new QStandardItem(*i));
+    Categorizer proxy;
+    proxy.setSourceModel(&source);
+    // the edit appends a category, building from scratch would put it first
+    source.item(0)->setText(QStringLiteral("d"));
+    QCOMPARE(proxy.rowCount(), 4);
+    QBuffer storage;
+    QVERIFY(storage.open(QIODevice::ReadWrite));
+    QVERIFY(proxy.saveStructure(&storage, 1));
+    QVERIFY(storage.seek(0));
+    Categorizer restored;
+    QVERIFY(restored.restoreStructure(&storage, 1));
+    restored.setSourceModel(&source);
+    QCOMPARE(restored.rowCount(), proxy.rowCount());
+    for (int i = 0; i < proxy.rowCount(); ++i) {
+        const QModelIndex catIdx = proxy.index(i, 0);
+        const QModelIndex restoredCatIdx = restored.index(i, 0);
+        QCOMPARE(restoredCatIdx.data(), catIdx.data());
+        QCOMPARE(restored.rowCount(restoredCatIdx), proxy.rowCount(catIdx));
+        for (int j = 0; j < proxy.rowCount(catIdx); ++j)
+            QCOMPARE(restored.mapToSource(restored.index(j, 0, restoredCatIdx)), proxy.mapToSource(proxy.index(j, 0, catIdx)));
+    }
+    QCOMPARE(restored.index(0, 0).data().toString(), QStringLiteral("b"));
+}
+
+void tst_Categorizer::categorizeRowsBelowDepth()
+{
+    QStandardItemModel source;
+    source.setColumnCount(1);
+    const QStringList groups{QStringLiteral("a,b"), QStringLiteral("b,c")};
+    for (auto i = groups.cbegin(); i != groups.cend(); ++i) {
+        QStandardItem* const group = new QStandardItem(*i);
+        const QStringList keys = i->split(QLatin1Char(','));
+        for (auto j = keys.cbegin(); j != keys.cend(); ++j)
+            group->appendRow(new QStandardItem(*j));
+        source.appendRow(group);
+    }
+    Categorizer proxy;
+    proxy.setSourceDepth(1);
+    proxy.setSourceModel(&source);
+    QCOMPARE(proxy.rowCount(), 3);
+    const QPersistentModelIndex bIdx = proxy.index(1, 0);
+    QCOMPARE(bIdx.data().toString(), QStringLiteral("b"));
+    QCOMPARE(proxy.rowCount(bIdx), 2);
+    QCOMPARE(proxy.mapToSource(proxy.index(0, 0, bIdx)), source.item(0)->child(1)->index());
+    QCOMPARE(proxy.mapToSource(proxy.index(1, 0, bIdx)), source.item(1)->child(0)->index());
+    // rows inserted under a parent at the depth are placed without a reset
+    QSignalSpy resetSpy(&proxy, &QAbstractItemModel::modelReset);
+    source.item(0)->insertRow(0, new QStandardItem(QStringLiteral("b")));
+    QCOMPARE(resetSpy.size(), 0);
+    QCOMPARE(proxy.rowCount(bIdx), 3);
+    QCOMPARE(proxy.mapToSource(proxy.index(0, 0, bIdx)), source.item(0)->child(0)->index());
+    QCOMPARE(proxy.mapToSource(proxy.index(2, 0, bIdx)), source.item(1)->child(0)->index());
+    // re-keying and removing rows of the second parent use the rows of the first one as an offset
+    source.item(1)->child(1)->setText(QStringLiteral("b"));
+    QCOMPARE(proxy.rowCount(), 2);
+    QCOMPARE(proxy.rowCount(bIdx), 4);
+    QCOMPARE(proxy.mapToSource(proxy.index(3, 0, bIdx)), source.item(1)->child(1)->index());
+    source.item(1)->removeRow(0);
+    QCOMPARE(resetSpy.size(), 0);
+    QCOMPARE(proxy.rowCount(bIdx), 3);
+    QCOMPARE(proxy.mapToSource(proxy.index(2, 0, bIdx)), source.item(1)->child(0)->index());
+    // a new parent changes which rows are categorized
+    QStandardItem* const group = new QStandardItem(QStringLiteral("d"));
+    group->appendRow(new QStandardItem(QStringLiteral("d")));
+    source.appendRow(group);
+    QCOMPARE(resetSpy.size(), 1);
+    QCOMPARE(proxy.rowCount(), 3);
+    QCOMPARE(proxy.index(2, 0).data().toString(), QStringLiteral("d"));
+}
+
+void tst_Categorizer::snapshotSharesUnchangedCategories()
+{
+    QStandardItemModel source;
+    source.setColumnCount(1);
+    const QStringList keys{QStringLiteral("a"), QStringLiteral("b"), QStringLiteral("a"), QStringLiteral("c")};
+    for (auto i = keys.cbegin(); i != keys.cend(); ++i)
+        source.appendRow(new QStandardItem(*i));
+    Categorizer proxy;
+    proxy.setLazyPopulation(true);
+    proxy.setFetchBatchSize(1);
+    proxy.setSourceModel(&source);
+    const CategorizerSnapshot first = proxy.snapshot();
+    QCOMPARE(first.categoryCount(), 3);
+    QCOMPARE(first.sourceRows(0), QVector<int>({0, 2}));
+    // building leaves that were pending and adding children under a leaf keep the same rows
+    const QModelIndex aIdx = proxy.index(0, 0);
+    proxy.fetchMore(aIdx);
+    QCOMPARE(proxy.rowCount(aIdx), 1);
+    source.item(0)->appendRow(new QStandardItem(QStringLiteral("child")));
+    const CategorizerSnapshot second = proxy.snapshot();
+    QCOMPARE(second.categoryRows(0), first.categoryRows(0));
+    QCOMPARE(second.categoryRows(2), first.categoryRows(2));
+    // a re-key only rebuilds the categories it touches
+    source.item(1)->setText(QStringLiteral("c"));
+    const CategorizerSnapshot third = proxy.snapshot();
+    QCOMPARE(third.categoryCount(), 2);
+    QCOMPARE(third.categoryRows(0), first.categoryRows(0));
+    QCOMPARE(third.sourceRows(1), QVector<int>({1, 3}));
+    // rows inserted at the top level renumber the rows after them
+    source.insertRow(0, new QStandardItem(QStringLiteral("c")));
+    const CategorizerSnapshot fourth = proxy.snapshot();
+    QCOMPARE(fourth.sourceRows(0), QVector<int>({1, 3}));
+    QCOMPARE(fourth.sourceRows(1), QVector<int>({0, 2, 4}));
+    QCOMPARE(first.sourceRows(0), QVector<int>({0, 2}));
+}
+
+void tst_Categorizer::dragOnlyEditableKeys()
+{
+    QStandardItemModel source;
+    fillModel(source, 2);
+    source.item(1)->setEditable(false);
+    Categorizer proxy;
+    proxy.setSourceModel(&source);
+    const QModelIndex editableLeaf = proxy.mapFromSource(source.index(0, 0));
+    const QModelIndex readOnlyLeaf = proxy.mapFromSource(source.index(1, 0));
+    QVERIFY(proxy.flags(editableLeaf).testFlag(Qt::ItemIsDragEnabled));
+    QVERIFY(proxy.flags(editableLeaf).testFlag(Qt::ItemIsDropEnabled));
+    QVERIFY(!proxy.flags(readOnlyLeaf).testFlag(Qt::ItemIsDragEnabled));
+    QVERIFY(!proxy.flags(readOnlyLeaf).testFlag(Qt::ItemIsDropEnabled));
+}
+
+QTEST_MAIN(tst_Categorizer)
+#include "tst_categorizer.moc"
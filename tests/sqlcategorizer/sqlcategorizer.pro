@@ -0,0 +1,9 @@
+QT += testlib
+QT -= gui
+CONFIG += testcase console
+CONFIG -= app_bundle
+TARGET = tst_sqlcategorizer
+
+include(../../sqlcategorizer.pri)
+
+SOURCES += tst_sqlcategorizer.cpp
@@ -0,0 +1,128 @@
+#include "sqlcategorizer.h"
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlQueryModel>
+#include <QtTest>
+
+class tst_SqlCategorizer : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void groupCounts();
+    void fetchOnDemand();
+    void unsortedQuery();
+private:
+    void checkLeaves(const SqlCategorizer& proxy);
+    QSqlDatabase m_db;
+};
+
+namespace {
+const int itemCount = 1000;
+const int categoryCount = 4;
+const QString connectionName = QStringLiteral("tst_sqlcategorizer");
+}
+
+void tst_SqlCategorizer::initTestCase()
+{
+    if (!QSqlDatabase::isDriverAvailable(QStringLiteral("QSQLITE")))
+        QSKIP("The SQLite driver is not available");
+    m_db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), connectionName);
+    m_db.setDatabaseName(QStringLiteral(":memory:"));
+    QVERIFY(m_db.open());
+    QSqlQuery fillQuery(m_db);
+    QVERIFY(fillQuery.exec(QStringLiteral("CREATE TABLE items (category TEXT, id INTEGER)")));
+    QVERIFY(m_db.transaction());
+    QVERIFY(fillQuery.prepare(QStringLiteral("INSERT INTO items (category, id) VALUES (?, ?)")));
+    // the categories alternate by id so ordering by id gives a source that is not sorted by key
+    for (int i = 0; i < itemCount; ++i) {
+        fillQuery.addBindValue(QString(QChar('a' + i % categoryCount)));
+        fillQuery.addBindValue(i);
+        QVERIFY(fillQuery.exec());
+    }
+    QVERIFY(m_db.commit());
+}
+
+void tst_SqlCategorizer::cleanupTestCase()
+{
+    m_db.close();
+    m_db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(connectionName);
+}
+
+void tst_SqlCategorizer::checkLeaves(const SqlCategorizer& proxy)
+{
+    for (int i = 0; i < proxy.rowCount(); ++i) {
+        const QModelIndex catIdx = proxy.index(i, 0);
+        const QVariant key = catIdx.data();
+        QVERIFY(proxy.categorySize(catIdx) >= proxy.rowCount(catIdx));
+        for (int j = 0; j < proxy.rowCount(catIdx); ++j)
+            QCOMPARE(proxy.index(j, 0, catIdx).data(), key);
+    }
+}
+
+void tst_SqlCategorizer::groupCounts()
+{
+    QSqlQueryModel source;
+    source.setQuery(QStringLiteral("SELECT category, id FROM items ORDER BY category, id"), m_db);
+    QVERIFY(source.rowCount() < itemCount);
+    SqlCategorizer proxy;
+    proxy.setSourceModel(&source);
+    // every category is known before its rows are fetched
+    QCOMPARE(proxy.rowCount(), categoryCount);
+    for (int i = 0; i < categoryCount; ++i) {
+        const QModelIndex catIdx = proxy.index(i, 0);
+        QCOMPARE(catIdx.data().toString(), QString(QChar('a' + i)));
+        QCOMPARE(proxy.categorySize(catIdx), itemCount / categoryCount);
+    }
+    QCOMPARE(proxy.rowCount(proxy.index(0, 0)), qMin(source.rowCount(), itemCount / categoryCount));
+    QCOMPARE(proxy.rowCount(proxy.index(categoryCount - 1, 0)), 0);
+    checkLeaves(proxy);
+}
+
+void tst_SqlCategorizer::fetchOnDemand()
+{
+    QSqlQueryModel source;
+    source.setQuery(QStringLiteral("SELECT category, id FROM items ORDER BY category, id"), m_db);
+    SqlCategorizer proxy;
+    proxy.setSourceModel(&source);
+    const QPersistentModelIndex lastCatIdx = proxy.index(categoryCount - 1, 0);
+    QVERIFY(proxy.canFetchMore(lastCatIdx));
+    proxy.fetchMore(lastCatIdx);
+    // the rows of the last category come after all the others
+    QCOMPARE(source.rowCount(), itemCount);
+    QCOMPARE(proxy.rowCount(lastCatIdx), itemCount / categoryCount);
+    QVERIFY(!proxy.canFetchMore(lastCatIdx));
+    QCOMPARE(proxy.rowCount(), categoryCount);
+    for (int i = 0; i < categoryCount; ++i)
+        QCOMPARE(proxy.rowCount(proxy.index(i, 0)), itemCount / categoryCount);
+    checkLeaves(proxy);
+}
+
+void tst_SqlCategorizer::unsortedQuery()
+{
+    QSqlQueryModel source;
+    source.setQuery(QStringLiteral("SELECT category, id FROM items ORDER BY id DESC"), m_db);
+    SqlCategorizer proxy;
+    proxy.setSourceModel(&source);
+    // the counts can't be used for rows that are not sorted by key, the categories only hold what was fetched
+    QCOMPARE(proxy.rowCount(), categoryCount);
+    int builtRows = 0;
+    for (int i = 0; i < categoryCount; ++i) {
+        const QModelIndex catIdx = proxy.index(i, 0);
+        QCOMPARE(proxy.categorySize(catIdx), proxy.rowCount(catIdx));
+        builtRows += proxy.rowCount(catIdx);
+    }
+    QCOMPARE(builtRows, source.rowCount());
+    checkLeaves(proxy);
+    while (proxy.canFetchMore(QModelIndex()))
+        proxy.fetchMore(QModelIndex());
+    QCOMPARE(source.rowCount(), itemCount);
+    for (int i = 0; i < categoryCount; ++i)
+        QCOMPARE(proxy.rowCount(proxy.index(i, 0)), itemCount / categoryCount);
+    checkLeaves(proxy);
+}
+
+QTEST_GUILESS_MAIN(tst_SqlCategorizer)
+#include "tst_sqlcategorizer.moc"
@@ -0,0 +1,257 @@
+#include "syntheticmodel.h"
+#include "../categorizer.h"
+#include "../sourcetrace.h"
+#include <QAbstractItemModelTester>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+
+namespace {
+int modelTesterFailures = 0;
+QtMessageHandler previousHandler = Q_NULLPTR;
+
+void countTesterFailures(QtMsgType type, const QMessageLogContext& context, const QString& message)
+{
+    if (context.category && qstrcmp(context.category, "qt.modeltest") == 0 && type != QtDebugMsg && type != QtInfoMsg)
+        ++modelTesterFailures;
+    if (previousHandler)
+        previousHandler(type, context, message);
+}
+
+QString eventName(int type)
+{
+    switch (type) {
+    case SourceTraceEvent::ModelReset: return QStringLiteral("modelReset");
+    case SourceTraceEvent::DataChanged: return QStringLiteral("dataChanged");
+    case SourceTraceEvent::RowsInserted: return QStringLiteral("rowsInserted");
+    case SourceTraceEvent::RowsRemoved: return QStringLiteral("rowsRemoved");
+    case SourceTraceEvent::ColumnsInserted: return QStringLiteral("columnsInserted");
+    default: return QString();
+    }
+}
+
+QString formatNanoseconds(qint64 ns)
+{
+    if (ns < 1000)
+        return QStringLiteral("%1ns").arg(ns);
+    if (ns < 1000000)
+        return QStringLiteral("%1us").arg(ns / 1000.0, 0, 'f', 1);
+    if (ns < 1000000000)
+        return QStringLiteral("%1ms").arg(ns / 1000000.0, 0, 'f', 1);
+    return QStringLiteral("%1s").arg(ns / 1000000000.0, 0, 'f', 2);
+}
+
+bool applyEvent(SyntheticModel& source, const SourceTraceEvent& event)
+{
+    const QModelIndex parent = source.indexForPath(event.parentPath);
+    if (parent.isValid() != !event.parentPath.isEmpty())
+        return false;
+    switch (event.type) {
+    case SourceTraceEvent::ModelReset:
+        source.resetContent(event.columnCount, event.keys, event.rowCounts, event.columnCounts);
+        return true;
+    case SourceTraceEvent::DataChanged:
+        return source.changeKeys(parent, event.first, event.last, event.firstColumn, event.lastColumn, event.roles, event.keys);
+    case SourceTraceEvent::RowsInserted: {
+        QVariantList keys = event.keys;
+        // keys are missing if the key column did not exist under that parent
+        while (keys.size() < event.last - event.first + 1)
+            keys.append(QVariant());
+        return source.insertKeyedRows(parent, event.first, keys);
+    }
+    case SourceTraceEvent::RowsRemoved:
+        return source.removeKeyedRows(parent, event.first, event.last);
+    case SourceTraceEvent::ColumnsInserted:
+        return source.insertKeyedColumns(parent, event.first, event.last);
+    default:
+        return false;
+    }
+}
+
+// every source row under the root must be in the categories its key is filed under, and only in those
+int countMappingFailures(const Categorizer& proxy, const SyntheticModel& source)
+{
+    // rows are numbered like the categorizer does, one parent at the depth after the other
+    QModelIndexList rowParents;
+    rowParents.append(proxy.sourceRoot());
+    for (int level = 0; level < proxy.sourceDepth(); ++level) {
+        QModelIndexList children;
+        for (auto i = rowParents.cbegin(); i != rowParents.cend(); ++i) {
+            const int childCnt = source.rowCount(*i);
+            for (int j = 0; j < childCnt; ++j)
+                children.append(source.index(j, 0, *i));
+        }
+        rowParents = children;
+    }
+    QVariantList rowKeys;
+    for (auto i = rowParents.cbegin(); i != rowParents.cend(); ++i) {
+        const int rowCnt = source.rowCount(*i);
+        for (int j = 0; j < rowCnt; ++j)
+            rowKeys.append(source.index(j, proxy.keyColumn(), *i).data(proxy.keyRole()));
+    }
+    // the snapshot also lists the rows whose leaves are not built yet
+    int failures = 0;
+    QVector<int> memberships(rowKeys.size(), 0);
+    const CategorizerSnapshot snapshot = proxy.snapshot();
+    for (int i = 0; i < snapshot.categoryCount(); ++i) {
+        const QVariant categoryKey = snapshot.categoryKey(i);
+        const QVector<int> categoryRows = snapshot.sourceRows(i);
+        for (auto j = categoryRows.cbegin(); j != categoryRows.cend(); ++j) {
+            if (*j < 0 || *j >= rowKeys.size()) {
+                ++failures;
+                continue;
+            }
+            ++memberships[*j];
+            const QVariantList keys = proxy.rowCategoryKeys(rowKeys.at(*j));
+            if (std::none_of(keys.cbegin(), keys.cend(), [&proxy, &categoryKey](const QVariant& key) -> bool { return proxy.sameCategory(key, categoryKey); }))
+                ++failures;
+        }
+    }
+    for (int i = 0; i < rowKeys.size(); ++i) {
+        if (memberships.at(i) != proxy.rowCategoryKeys(rowKeys.at(i)).size())
+            ++failures;
+    }
+    return failures;
+}
+
+struct ReplayResult{
+    ReplayResult()
+        : latencies(SourceTraceEvent::TypeCount)
+        , totalTime(0)
+        , replayFailures(0)
+        , mappingFailures(0)
+    {}
+    QVector<QVector<qint64> > latencies;
+    qint64 totalTime;
+    int replayFailures;
+    int mappingFailures;
+};
+
+// every pass starts from an empty source so the passes don't depend on each other
+ReplayResult replayTrace(const SourceTrace& trace, int repeat, bool attachTester, bool verify)
+{
+    ReplayResult result;
+    SyntheticModel source(trace.keyColumn, trace.keyRole);
+    Categorizer proxy;
+    proxy.setKeyColumn(trace.keyColumn);
+    proxy.setKeyRole(trace.keyRole);
+    if (!trace.collationLocale.isEmpty())
+        proxy.setCollationLocale(QLocale(trace.collationLocale));
+    proxy.setKeyNormalization(Categorizer::KeyNormalization(trace.keyNormalization));
+    proxy.setMultiValuedKeys(trace.multiValuedKeys);
+    proxy.setLazyPopulation(trace.lazyPopulation);
+    proxy.setFetchBatchSize(trace.fetchBatchSize);
+    proxy.setTopCategories(trace.topCategories);
+    proxy.setCategoryThreshold(trace.categoryThreshold);
+    proxy.setSourceDepth(trace.sourceDepth);
+    proxy.setSourceModel(&source);
+    QAbstractItemModelTester* tester = Q_NULLPTR;
+    if (attachTester)
+        tester = new QAbstractItemModelTester(&proxy, QAbstractItemModelTester::FailureReportingMode::Warning, &proxy);
+    QElapsedTimer handlerClock;
+    QElapsedTimer totalClock;
+    totalClock.start();
+    for (int r = 0; r < repeat; ++r) {
+        for (auto i = trace.events.cbegin(); i != trace.events.cend(); ++i) {
+            handlerClock.start();
+            const bool applied = applyEvent(source, *i);
+            const qint64 elapsed = handlerClock.nsecsElapsed();
+            if (!applied) {
+                ++result.replayFailures;
+                continue;
+            }
+            result.latencies[i->type].append(elapsed);
+            // like a view, the proxy loses its root on a source reset, the recorded one is set again
+            if (i->type == SourceTraceEvent::ModelReset && !trace.rootPath.isEmpty())
+                proxy.setSourceRoot(source.indexForPath(trace.rootPath));
+            if (verify)
+                result.mappingFailures += countMappingFailures(proxy, source);
+        }
+    }
+    result.totalTime = totalClock.nsecsElapsed();
+    delete tester;
+    return result;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("tracereplay"));
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Replays a source signal trace against a Categorizer"));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("trace"), QStringLiteral("Trace file recorded with SourceTraceRecorder"));
+    const QCommandLineOption noTesterOption(QStringLiteral("no-tester"), QStringLiteral("Do not attach QAbstractItemModelTester to the proxy"));
+    const QCommandLineOption verifyOption(QStringLiteral("verify"), QStringLiteral("Check the mapping of every source row after each event"));
+    const QCommandLineOption repeatOption(QStringLiteral("repeat"), QStringLiteral("Replay the trace <n> times"), QStringLiteral("n"), QStringLiteral("1"));
+    parser.addOption(noTesterOption);
+    parser.addOption(verifyOption);
+    parser.addOption(repeatOption);
+    parser.process(app);
+    QTextStream out(stdout);
+    if (parser.positionalArguments().size() != 1)
+        parser.showHelp(1);
+    QFile traceFile(parser.positionalArguments().first());
+    SourceTrace trace;
+    if (!traceFile.open(QIODevice::ReadOnly) || !SourceTraceRecorder::readTrace(&traceFile, trace) || trace.events.isEmpty()) {
+        out << "Unable to read trace " << traceFile.fileName() << Qt::endl;
+        return 1;
+    }
+    const int repeat = qMax(1, parser.value(repeatOption).toInt());
+
+    // the tester and the mapping checks would dominate the latencies, they get a pass of their own
+    ReplayResult timing = replayTrace(trace, repeat, false, false);
+    const bool attachTester = !parser.isSet(noTesterOption);
+    ReplayResult checks;
+    if (attachTester || parser.isSet(verifyOption)) {
+        if (attachTester)
+            previousHandler = qInstallMessageHandler(countTesterFailures);
+        checks = replayTrace(trace, 1, attachTester, parser.isSet(verifyOption));
+        // a null handler puts back the default one
+        if (attachTester)
+            qInstallMessageHandler(previousHandler);
+    }
+    const qint64 totalTime = timing.totalTime;
+    const int replayFailures = timing.replayFailures;
+    const int mappingFailures = checks.mappingFailures;
+
+    const int eventCount = trace.events.size() * repeat;
+    out << "Events: " << eventCount << " in " << formatNanoseconds(totalTime)
+        << " (" << QString::number(totalTime > 0 ? eventCount * 1000000000.0 / totalTime : 0.0, 'f', 0) << " events/s)" << Qt::endl;
+    for (int type = 0; type < SourceTraceEvent::TypeCount; ++type) {
+        QVector<qint64>& samples = timing.latencies[type];
+        if (samples.isEmpty())
+            continue;
+        std::sort(samples.begin(), samples.end());
+        qint64 sum = 0;
+        for (auto i = samples.cbegin(); i != samples.cend(); ++i)
+            sum += *i;
+        out << eventName(type) << ": " << samples.size()
+            << " mean " << formatNanoseconds(sum / samples.size())
+            << " p50 " << formatNanoseconds(samples.at(samples.size() / 2))
+            << " p99 " << formatNanoseconds(samples.at((samples.size() * 99) / 100))
+            << " max " << formatNanoseconds(samples.last()) << Qt::endl;
+        // power of two buckets
+        int bucketStart = 0;
+        while (bucketStart < samples.size()) {
+            int bucket = 0;
+            while ((qint64(1) << (bucket + 1)) <= samples.at(bucketStart))
+                ++bucket;
+            const qint64 bucketEnd = qint64(1) << (bucket + 1);
+            const auto bucketEndIter = std::lower_bound(samples.cbegin() + bucketStart, samples.cend(), bucketEnd);
+            const int bucketCount = bucketEndIter - (samples.cbegin() + bucketStart);
+            out << "    [" << formatNanoseconds(samples.at(bucketStart) > 0 ? qint64(1) << bucket : 0) << ", " << formatNanoseconds(bucketEnd) << "): " << bucketCount << Qt::endl;
+            bucketStart += bucketCount;
+        }
+    }
+    out << "Replay failures: " << replayFailures << Qt::endl;
+    if (attachTester)
+        out << "Model tester failures: " << modelTesterFailures << Qt::endl;
+    if (parser.isSet(verifyOption))
+        out << "Mapping failures: " << mappingFailures << Qt::endl;
+    return (replayFailures || modelTesterFailures || mappingFailures) ? 1 : 0;
+}
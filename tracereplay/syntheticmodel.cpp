@@ -0,0 +1,156 @@
+#include "syntheticmodel.h"
+
+SyntheticModel::Node::Node(Node* par, const QVariant& k)
+    : parent(par)
+    , childColumns(par ? par->childColumns : 0)
+    , key(k)
+{}
+
+SyntheticModel::Node::~Node()
+{
+    qDeleteAll(children);
+}
+
+SyntheticModel::SyntheticModel(int keyColumn, int keyRole, QObject* parent)
+    : QAbstractItemModel(parent)
+    , m_keyColumn(keyColumn)
+    , m_keyRole(keyRole)
+{}
+
+SyntheticModel::Node* SyntheticModel::nodeForIndex(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return const_cast<Node*>(&m_root);
+    Q_ASSERT(index.model() == this);
+    const Node* const parentNode = static_cast<const Node*>(index.internalPointer());
+    return parentNode->children.value(index.row(), Q_NULLPTR);
+}
+
+QModelIndex SyntheticModel::index(int row, int column, const QModelIndex &parent) const
+{
+    const Node* const parentNode = nodeForIndex(parent);
+    if (!parentNode || row < 0 || row >= parentNode->children.size() || column < 0 || column >= parentNode->childColumns)
+        return QModelIndex();
+    return createIndex(row, column, const_cast<Node*>(parentNode));
+}
+
+QModelIndex SyntheticModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid())
+        return QModelIndex();
+    Node* const parentNode = static_cast<Node*>(child.internalPointer());
+    if (parentNode == &m_root)
+        return QModelIndex();
+    return createIndex(parentNode->parent->children.indexOf(parentNode), 0, parentNode->parent);
+}
+
+int SyntheticModel::rowCount(const QModelIndex &parent) const
+{
+    // only the first column has children
+    if (parent.column() > 0)
+        return 0;
+    const Node* const parentNode = nodeForIndex(parent);
+    return parentNode ? parentNode->children.size() : 0;
+}
+
+int SyntheticModel::columnCount(const QModelIndex &parent) const
+{
+    const Node* const parentNode = nodeForIndex(parent);
+    return parentNode ? parentNode->childColumns : 0;
+}
+
+QVariant SyntheticModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.column() != m_keyColumn || role != m_keyRole)
+        return QVariant();
+    const Node* const node = nodeForIndex(index);
+    return node ? node->key : QVariant();
+}
+
+QModelIndex SyntheticModel::indexForPath(const QVector<int>& path) const
+{
+    QModelIndex result;
+    for (auto i = path.cbegin(); i != path.cend(); ++i) {
+        result = index(*i, 0, result);
+        if (!result.isValid())
+            break;
+    }
+    return result;
+}
+
+void SyntheticModel::appendSubtree(Node* parentNode, const QVariantList& keys, const QVector<int>& rowCounts, const QVector<int>& columnCounts, int& keyIndex)
+{
+    Node* const node = new Node(parentNode, keys.at(keyIndex));
+    parentNode->children.append(node);
+    // without the counts every row is a leaf
+    const int childCount = rowCounts.value(keyIndex, 0);
+    if (!columnCounts.isEmpty())
+        node->childColumns = columnCounts.at(keyIndex);
+    ++keyIndex;
+    for (int i = 0; i < childCount && keyIndex < keys.size(); ++i)
+        appendSubtree(node, keys, rowCounts, columnCounts, keyIndex);
+}
+
+void SyntheticModel::resetContent(int columnCount, const QVariantList& keys, const QVector<int>& rowCounts, const QVector<int>& columnCounts)
+{
+    beginResetModel();
+    qDeleteAll(m_root.children);
+    m_root.children.clear();
+    m_root.childColumns = columnCount;
+    // the keys list the rows depth first, each followed by its children
+    int keyIndex = 0;
+    while (keyIndex < keys.size())
+        appendSubtree(&m_root, keys, rowCounts, columnCounts, keyIndex);
+    endResetModel();
+}
+
+bool SyntheticModel::insertKeyedRows(const QModelIndex &parent, int first, const QVariantList& keys)
+{
+    Node* const parentNode = nodeForIndex(parent);
+    if (!parentNode || keys.isEmpty() || first < 0 || first > parentNode->children.size())
+        return false;
+    if (parentNode->childColumns == 0)
+        parentNode->childColumns = m_root.childColumns;
+    beginInsertRows(parent, first, first + keys.size() - 1);
+    for (int i = 0; i < keys.size(); ++i)
+        parentNode->children.insert(first + i, new Node(parentNode, keys.at(i)));
+    endInsertRows();
+    return true;
+}
+
+bool SyntheticModel::removeKeyedRows(const QModelIndex &parent, int first, int last)
+{
+    Node* const parentNode = nodeForIndex(parent);
+    if (!parentNode || first < 0 || last < first || last >= parentNode->children.size())
+        return false;
+    beginRemoveRows(parent, first, last);
+    for (; first <= last; --last)
+        delete parentNode->children.takeAt(last);
+    endRemoveRows();
+    return true;
+}
+
+bool SyntheticModel::insertKeyedColumns(const QModelIndex &parent, int first, int last)
+{
+    Node* const parentNode = nodeForIndex(parent);
+    if (!parentNode || first < 0 || last < first || first > parentNode->childColumns)
+        return false;
+    beginInsertColumns(parent, first, last);
+    parentNode->childColumns += last - first + 1;
+    endInsertColumns();
+    return true;
+}
+
+bool SyntheticModel::changeKeys(const QModelIndex &parent, int first, int last, int firstColumn, int lastColumn, const QVector<int>& roles, const QVariantList& keys)
+{
+    const QModelIndex topLeft = index(first, firstColumn, parent);
+    const QModelIndex bottomRight = index(last, lastColumn, parent);
+    if (!topLeft.isValid() || !bottomRight.isValid())
+        return false;
+    Node* const parentNode = nodeForIndex(parent);
+    const int keyCount = qMin(keys.size(), last - first + 1);
+    for (int i = 0; i < keyCount; ++i)
+        parentNode->children.at(first + i)->key = keys.at(i);
+    dataChanged(topLeft, bottomRight, roles);
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef SYNTHETICMODEL_H
+#define SYNTHETICMODEL_H
+
+#include <QAbstractItemModel>
+#include <QVector>
+
+// Minimal tree model that only stores the key of every row, used to replay recorded source signals
+class SyntheticModel : public QAbstractItemModel
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(SyntheticModel)
+public:
+    SyntheticModel(int keyColumn, int keyRole, QObject* parent = Q_NULLPTR);
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    QModelIndex parent(const QModelIndex &child) const Q_DECL_OVERRIDE;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const Q_DECL_OVERRIDE;
+    QModelIndex indexForPath(const QVector<int>& path) const;
+    void resetContent(int columnCount, const QVariantList& keys, const QVector<int>& rowCounts = QVector<int>(), const QVector<int>& columnCounts = QVector<int>());
+    bool insertKeyedRows(const QModelIndex &parent, int first, const QVariantList& keys);
+    bool removeKeyedRows(const QModelIndex &parent, int first, int last);
+    bool insertKeyedColumns(const QModelIndex &parent, int first, int last);
+    bool changeKeys(const QModelIndex &parent, int first, int last, int firstColumn, int lastColumn, const QVector<int>& roles, const QVariantList& keys);
+private:
+    struct Node{
+        Node(Node* par = Q_NULLPTR, const QVariant& k = QVariant());
+        ~Node();
+        Node* parent;
+        int childColumns;
+        QVariant key;
+        QVector<Node*> children;
+    };
+    Node* nodeForIndex(const QModelIndex &index) const;
+    void appendSubtree(Node* parentNode, const QVariantList& keys, const QVector<int>& rowCounts, const QVector<int>& columnCounts, int& keyIndex);
+    Node m_root;
+    int m_keyColumn;
+    int m_keyRole;
+};
+
+#endif // SYNTHETICMODEL_H
@@ -0,0 +1,16 @@
+QT += testlib
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+TARGET = tracereplay
+
+include(../categorizer.pri)
+
+HEADERS += \
+    ../sourcetrace.h \
+    syntheticmodel.h
+
+SOURCES += \
+    ../sourcetrace.cpp \
+    main.cpp \
+    syntheticmodel.cpp